@@ -0,0 +1,554 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cmd.h"
+#include "frame.h"
+#include "io.h"
+#include "serial.h"
+#include "timeutil.h"
+
+#define BAUD_SWEEP_COUNT		4096
+#define BAUD_SWEEP_CONTROL_BAUD		115200
+#define BAUD_SWEEP_FRAME_SIZE		256
+#define BAUD_SWEEP_SYNC_TIMEOUT_MS	1000
+#define BAUD_SWEEP_START_TIMEOUT_MS	2000
+#define BAUD_SWEEP_IDLE_TIMEOUT_MS	500
+#define BAUD_SWEEP_SETTLE_MS		50
+#define BAUD_SWEEP_REPORT_TIMEOUT_MS	10000
+
+static const char baud_sweep_help[] = "Usage:\n"
+	"\t uart_test baud_sweep [options] <ttyDevice>\n"
+	"Options:\n"
+	"\t-r, --receiver\t\trun as receiver\n"
+	"\t-s, --sender\t\trun as sender (default)\n"
+	"\t-b, --baudrates <list>\tcomma separated rates or <from>-<to>:<step>\n"
+	"\t\t\t\tranges (sender only)\n"
+	"\t-n, --count <bytes>\tpayload streamed at each rate (default 4096,\n"
+	"\t\t\t\tsender only)\n"
+	"\t-c, --control <baud>\trate used to coordinate with the peer "
+	"(default 115200)\n";
+
+static const char default_baudrates[] =
+	"9600,19200,38400,57600,115200,230400,460800,921600";
+
+enum {
+	BAUD_COUNT = 1,
+	BAUD_REQ,
+	BAUD_OKAY,
+	BAUD_READY,
+	BAUD_REPORT,
+	BAUD_DONE
+};
+
+struct baud_sweep_data {
+	int receiver;
+	int fd;
+	struct port *port;
+	int count;
+	int control;
+	int orig_baudrate;
+	int *baudrates;
+	int nbaudrates;
+};
+
+struct baud_report {
+	uint32_t bytes;
+	uint32_t duration_us;	/* first to last received byte */
+	uint32_t frames;
+	uint32_t lost;
+	uint32_t corrupted;
+};
+
+static int add_baudrate(struct baud_sweep_data *pdata, long baudrate)
+{
+	int *tmp;
+
+	if (baudrate <= 0)
+		return -EINVAL;
+
+	tmp = realloc(pdata->baudrates,
+		(pdata->nbaudrates + 1) * sizeof(*tmp));
+	if (!tmp)
+		return -ENOMEM;
+
+	pdata->baudrates = tmp;
+	pdata->baudrates[pdata->nbaudrates++] = baudrate;
+
+	return 0;
+}
+
+static int parse_baudrates(struct baud_sweep_data *pdata, const char *list)
+{
+	char *copy, *token, *saveptr = NULL;
+	long from, to, step;
+	int ret = 0;
+
+	copy = strdup(list);
+	if (!copy)
+		return -ENOMEM;
+
+	for (token = strtok_r(copy, ",", &saveptr); token && !ret;
+			token = strtok_r(NULL, ",", &saveptr)) {
+		if (sscanf(token, "%ld-%ld:%ld", &from, &to, &step) == 3) {
+			if (step <= 0 || to < from) {
+				ret = -EINVAL;
+				break;
+			}
+			for (; from <= to && !ret; from += step)
+				ret = add_baudrate(pdata, from);
+		} else {
+			ret = add_baudrate(pdata, strtol(token, NULL, 10));
+		}
+	}
+
+	free(copy);
+	return ret;
+}
+
+static int switch_baudrate(struct port *port, int baudrate)
+{
+	int ret;
+
+	/* Let pending output leave at the old rate */
+	tcdrain(port->fd);
+
+	ret = port_set_baudrate(port, baudrate);
+	if (ret)
+		return ret;
+
+	/* Drop whatever was garbled by the switch */
+	tcflush(port->fd, TCIFLUSH);
+
+	return 0;
+}
+
+static void sleep_ms(int ms)
+{
+	struct timespec ts = ns_to_ts(ms * NSEC_PER_MSEC);
+
+	while (nanosleep(&ts, &ts) && errno == EINTR)
+		;
+}
+
+static int baud_sweep_init(struct cmd *cmd, int argc, char *argv[])
+{
+	int ret, c;
+	const char *list = default_baudrates;
+	struct baud_sweep_data *pdata;
+
+	pdata = (struct baud_sweep_data *)calloc(1,
+		sizeof(struct baud_sweep_data));
+	if (!pdata)
+		return -ENOMEM;
+
+	static struct option long_options[] = {
+		{"receiver", no_argument, 0, 'r'},
+		{"sender", no_argument, 0, 's'},
+		{"baudrates", required_argument, 0, 'b'},
+		{"count", required_argument, 0, 'n'},
+		{"control", required_argument, 0, 'c'},
+		{0, 0, 0, 0}
+	};
+
+	pdata->count = BAUD_SWEEP_COUNT;
+	pdata->control = BAUD_SWEEP_CONTROL_BAUD;
+
+	while (1) {
+		int option_index = 0;
+
+		c = getopt_long(argc, argv, "rsb:n:c:", long_options,
+			&option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'r':
+			pdata->receiver = 1;
+			break;
+		case 's':
+			pdata->receiver = 0;
+			break;
+		case 'b':
+			list = optarg;
+			break;
+		case 'n':
+			pdata->count = atoi(optarg);
+			break;
+		case 'c':
+			pdata->control = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "baud_sweep: Invalid option %s\n",
+				optarg);
+			ret = -EINVAL;
+			goto e_exit;
+		}
+	}
+
+	if (pdata->count < FRAME_OVERHEAD || pdata->control <= 0) {
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	ret = parse_baudrates(pdata, list);
+	if (ret) {
+		fprintf(stderr, "baud_sweep: Invalid baudrate list %s\n", list);
+		goto e_exit;
+	}
+
+	if (optind != argc - 1) {
+		fprintf(stderr, "Please specify the tty device");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	/* Saves the settings before the switch, they are restored last */
+	pdata->fd = cmd_open_port(cmd, argv[optind], 0, 0);
+	if (pdata->fd < 0) {
+		ret = pdata->fd;
+		goto e_exit;
+	}
+
+	pdata->port = &cmd->port;
+	pdata->orig_baudrate = port_get_baudrate(pdata->port);
+
+	ret = switch_baudrate(pdata->port, pdata->control);
+	if (ret)
+		goto e_exit;
+
+	cmd->priv = (void *) pdata;
+
+	return 0;
+
+e_exit:
+	free(pdata->baudrates);
+	free(pdata);
+	return ret;
+}
+
+/* Receives one payload, timing the first and last byte */
+static int receive_payload(struct baud_sweep_data *pdata,
+		struct baud_report *report)
+{
+	struct pollfd pfd = { .fd = pdata->fd, .events = POLLIN };
+	struct frame_parser *parser;
+	uint64_t first = 0, last = 0, total = 0;
+	char buf[FRAME_MAX_SIZE];
+	ssize_t count;
+	int ret = 0;
+
+	parser = (struct frame_parser *)malloc(sizeof(*parser));
+	if (!parser)
+		return -ENOMEM;
+
+	frame_parser_init(parser);
+
+	while (total < (uint64_t)pdata->count) {
+		ret = poll(&pfd, 1, first ? BAUD_SWEEP_IDLE_TIMEOUT_MS :
+			BAUD_SWEEP_START_TIMEOUT_MS);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			break;
+		}
+		if (ret == 0)
+			break;
+
+		count = pdata->count - total;
+		if (count > (ssize_t)sizeof(buf))
+			count = sizeof(buf);
+
+		count = read(pdata->fd, buf, count);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			break;
+		}
+		/* Readable but empty: the other end hung up */
+		if (count == 0) {
+			ret = -EPIPE;
+			break;
+		}
+
+		last = now_ns();
+		if (!first)
+			first = last;
+
+		frame_parser_feed(parser, buf, count);
+		total += count;
+	}
+
+	report->bytes = total;
+	report->duration_us = (last - first) / NSEC_PER_USEC;
+	report->frames = parser->stats.frames;
+	report->lost = parser->stats.lost;
+	report->corrupted = parser->stats.corrupted;
+
+	free(parser);
+	return ret < 0 ? ret : 0;
+}
+
+static void print_header(void)
+{
+	printf("%10s %10s %12s %10s %12s %8s %8s %8s\n", "Nominal", "Actual",
+		"Measured", "Deviation", "Bytes/s", "Frames", "Lost",
+		"Corrupt");
+}
+
+static void print_step(struct baud_sweep_data *pdata, int nominal, int actual,
+		struct baud_report *report)
+{
+	int bits = serial_bits_per_char(pdata->fd);
+	double measured = 0, rate = 0;
+
+	/* N bytes take N - 1 character times between first and last byte */
+	if (report->duration_us && report->bytes > 1) {
+		measured = (double)(report->bytes - 1) * bits * 1000000 /
+			report->duration_us;
+		rate = (double)(report->bytes - 1) * 1000000 /
+			report->duration_us;
+	}
+
+	printf("%10d %10d %12.0f %9.2f%% %12.0f %8" PRIu32 " %8" PRIu32
+		" %8" PRIu32 "%s\n", nominal, actual, measured, measured ?
+		100.0 * (measured - nominal) / nominal : 0, rate,
+		report->frames, report->lost, report->corrupted,
+		report->bytes < (uint32_t)pdata->count ? " (incomplete)" : "");
+}
+
+static int baud_sweep_receiver(struct baud_sweep_data *pdata,
+		struct results *results)
+{
+	struct baud_report report;
+	int type, baudrate, actual, ret;
+
+	print_header();
+
+	while (1) {
+		ret = read_msg(pdata->fd, &type, &baudrate, -1);
+		if (ret)
+			return ret;
+
+		if (type == BAUD_DONE)
+			return 0;
+		if (type == BAUD_COUNT && baudrate >= FRAME_OVERHEAD) {
+			pdata->count = baudrate;
+			continue;
+		}
+		if (type != BAUD_REQ)
+			return -EPROTO;
+
+		ret = send_msg(pdata->fd, BAUD_OKAY, 0);
+		if (!ret)
+			ret = switch_baudrate(pdata->port, baudrate);
+		if (ret)
+			return ret;
+
+		actual = serial_get_baudrate(pdata->fd);
+
+		/* The sender flushes its input once it switched too */
+		sleep_ms(BAUD_SWEEP_SETTLE_MS);
+		ret = send_msg(pdata->fd, BAUD_READY, 0);
+		if (ret)
+			return ret;
+
+		memset(&report, 0, sizeof(report));
+		ret = receive_payload(pdata, &report);
+		if (ret)
+			return ret;
+
+		print_step(pdata, baudrate, actual, &report);
+		results_add_u64(results, "steps", 1);
+		results_add_u64(results, "rx_bytes", report.bytes);
+		results_add_u64(results, "errors", report.lost +
+			report.corrupted);
+
+		/* Give the sender time to switch back before reporting */
+		sleep_ms(BAUD_SWEEP_SETTLE_MS);
+		ret = switch_baudrate(pdata->port, pdata->control);
+		if (ret)
+			return ret;
+
+		ret = send_msg(pdata->fd, BAUD_REPORT, report.bytes);
+		if (!ret)
+			ret = send_msg(pdata->fd, BAUD_REPORT,
+				report.duration_us);
+		if (!ret)
+			ret = send_msg(pdata->fd, BAUD_REPORT, report.frames);
+		if (!ret)
+			ret = send_msg(pdata->fd, BAUD_REPORT, report.lost);
+		if (!ret)
+			ret = send_msg(pdata->fd, BAUD_REPORT,
+				report.corrupted);
+		if (ret)
+			return ret;
+	}
+}
+
+static int baud_sweep_sender(struct baud_sweep_data *pdata,
+		struct results *results)
+{
+	struct baud_report report;
+	uint32_t seq = 0;
+	char *payload, *p;
+	int i, baudrate, actual, size, left, arg, ret = 0;
+
+	payload = malloc(pdata->count);
+	if (!payload)
+		return -ENOMEM;
+
+	print_header();
+
+	for (i = 0; i < pdata->nbaudrates; i++) {
+		baudrate = pdata->baudrates[i];
+		seq = 0;
+
+		ret = send_msg(pdata->fd, BAUD_COUNT, pdata->count);
+		if (!ret)
+			ret = send_msg(pdata->fd, BAUD_REQ, baudrate);
+		if (!ret)
+			ret = expect_msg(pdata->fd, BAUD_OKAY, NULL,
+				BAUD_SWEEP_REPORT_TIMEOUT_MS);
+		if (!ret)
+			ret = switch_baudrate(pdata->port, baudrate);
+		if (ret)
+			break;
+
+		actual = serial_get_baudrate(pdata->fd);
+
+		/* Without READY the receiver times out and reports nothing */
+		if (!expect_msg(pdata->fd, BAUD_READY, NULL,
+				BAUD_SWEEP_SYNC_TIMEOUT_MS)) {
+			for (p = payload, left = pdata->count; left > 0;
+					p += size, left -= size) {
+				size = left < BAUD_SWEEP_FRAME_SIZE ?
+					left : BAUD_SWEEP_FRAME_SIZE;
+				if (size < FRAME_OVERHEAD)
+					memset(p, 0, size);
+				else
+					frame_build(p, size, seq++);
+			}
+
+			ret = write_full(pdata->fd, payload, pdata->count);
+			if (ret)
+				break;
+			results_add_u64(results, "tx_bytes", pdata->count);
+		}
+
+		ret = switch_baudrate(pdata->port, pdata->control);
+		if (ret)
+			break;
+
+		ret = expect_msg(pdata->fd, BAUD_REPORT, &arg,
+			BAUD_SWEEP_REPORT_TIMEOUT_MS);
+		if (!ret) {
+			report.bytes = arg;
+			ret = expect_msg(pdata->fd, BAUD_REPORT, &arg,
+				BAUD_SWEEP_REPORT_TIMEOUT_MS);
+		}
+		if (!ret) {
+			report.duration_us = arg;
+			ret = expect_msg(pdata->fd, BAUD_REPORT, &arg,
+				BAUD_SWEEP_REPORT_TIMEOUT_MS);
+		}
+		if (!ret) {
+			report.frames = arg;
+			ret = expect_msg(pdata->fd, BAUD_REPORT, &arg,
+				BAUD_SWEEP_REPORT_TIMEOUT_MS);
+		}
+		if (!ret) {
+			report.lost = arg;
+			ret = expect_msg(pdata->fd, BAUD_REPORT, &arg,
+				BAUD_SWEEP_REPORT_TIMEOUT_MS);
+		}
+		if (ret)
+			break;
+		report.corrupted = arg;
+
+		print_step(pdata, baudrate, actual, &report);
+		results_add_u64(results, "steps", 1);
+		results_add_u64(results, "errors", report.lost +
+			report.corrupted +
+			(report.bytes < (uint32_t)pdata->count));
+	}
+
+	if (!ret)
+		ret = send_msg(pdata->fd, BAUD_DONE, 0);
+
+	free(payload);
+	return ret;
+}
+
+static int baud_sweep_exec(struct cmd *cmd)
+{
+	struct baud_sweep_data *pdata = (struct baud_sweep_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	if (pdata->receiver)
+		return baud_sweep_receiver(pdata, &cmd->results);
+
+	return baud_sweep_sender(pdata, &cmd->results);
+}
+
+static int baud_sweep_cleanup(struct cmd *cmd)
+{
+	struct baud_sweep_data *pdata = (struct baud_sweep_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	if (pdata->orig_baudrate > 0)
+		switch_baudrate(pdata->port, pdata->orig_baudrate);
+
+	free(pdata->baudrates);
+	free(pdata);
+	cmd->priv = NULL;
+
+	return 0;
+}
+
+REGISTER_CMD(
+	baud_sweep,
+	"Throughput and bit clock accuracy over a range of baudrates",
+	baud_sweep_help,
+	baud_sweep_init,
+	baud_sweep_exec,
+	baud_sweep_cleanup,
+	.peer_opt = "-r"
+);
@@ -0,0 +1,457 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "cmd.h"
+#include "histogram.h"
+#include "timeutil.h"
+
+#define BREAK_DETECT_DURATION		10
+#define BREAK_DETECT_COUNT		100
+#define BREAK_DETECT_WIDTH_US		10000
+#define BREAK_DETECT_BUF_SIZE		256
+#define BREAK_DETECT_TIMEOUT_MS		1000
+#define BREAK_DETECT_START_TIMEOUT_MS	10000
+
+static const char break_detect_help[] = "Usage:\n"
+	"\t uart_test break_detect [options] <ttyDevice>\n"
+	"Detects breaks as in-band PARMRK markers and timestamps every one of\n"
+	"them. By default the port is monitored for --duration seconds; in\n"
+	"ping-pong mode breaks are sent to a peer that echoes them, which\n"
+	"measures the detection latency. A pseudo-terminal cannot carry a\n"
+	"break, so --loopback pty is not supported.\n"
+	"Options:\n"
+	"\t-d, --duration <sec>\tmonitoring time (default 10)\n"
+	"\t-n, --count <n>\t\tstop after <n> breaks when monitoring, breaks\n"
+	"\t\t\t\tto send in ping-pong mode (default 100)\n"
+	"\t-p, --pingpong\t\tsend breaks and time the echoed ones\n"
+	"\t-e, --echo\t\techo every break that is detected\n"
+	"\t-w, --width <usec>\twidth of the breaks sent (default 10000)\n";
+
+struct break_detect_data {
+	int pingpong;
+	int echo;	/* takes precedence, the peer gets the client's options */
+	int fd;
+	int duration;
+	int count;
+	int width_us;
+};
+
+/*
+ * With PARMRK set and IGNBRK and BRKINT clear, a break reads as \377 \0 \0,
+ * a character received with an error as \377 \0 <char>, and a valid \377
+ * as \377 \377.
+ */
+struct parmrk_parser {
+	int state;
+	uint64_t breaks;
+	uint64_t errors;
+	uint64_t bytes;
+};
+
+/* Returns the number of breaks in buf */
+static int parmrk_feed(struct parmrk_parser *p, const unsigned char *buf,
+		size_t len)
+{
+	int breaks = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		switch (p->state) {
+		case 0:
+			if (buf[i] == 0377)
+				p->state = 1;
+			else
+				p->bytes++;
+			break;
+		case 1:
+			if (buf[i] == 0377) {
+				p->bytes++;
+				p->state = 0;
+			} else {
+				p->state = 2;
+			}
+			break;
+		default:
+			if (buf[i]) {
+				p->errors++;
+			} else {
+				p->breaks++;
+				breaks++;
+			}
+			p->state = 0;
+			break;
+		}
+	}
+
+	return breaks;
+}
+
+static int send_break(int fd, int width_us)
+{
+	struct timespec width = ns_to_ts(width_us * NSEC_PER_USEC);
+	int ret = 0;
+
+	if (ioctl(fd, TIOCSBRK) < 0)
+		return -errno;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &width, &width) == EINTR)
+		;
+
+	if (ioctl(fd, TIOCCBRK) < 0)
+		ret = -errno;
+
+	return ret;
+}
+
+/*
+ * Waits for input at most timeout_ms. Returns the number of breaks read,
+ * with *when set to the time the read returned, -ETIMEDOUT or -errno.
+ */
+static int read_breaks(struct break_detect_data *pdata,
+		struct parmrk_parser *parser, int timeout_ms, uint64_t *when)
+{
+	unsigned char buf[BREAK_DETECT_BUF_SIZE];
+	struct pollfd pfd;
+	ssize_t count;
+	int ret;
+
+	pfd.fd = pdata->fd;
+	pfd.events = POLLIN;
+
+	while (1) {
+		ret = poll(&pfd, 1, timeout_ms);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -errno;
+		if (ret == 0)
+			return -ETIMEDOUT;
+
+		count = read(pdata->fd, buf, sizeof(buf));
+		*when = now_ns();
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count < 0)
+			return -errno;
+
+		return parmrk_feed(parser, buf, count);
+	}
+}
+
+static int break_monitor(struct break_detect_data *pdata,
+		struct results *results)
+{
+	struct parmrk_parser parser;
+	struct histogram *interval;
+	uint64_t start, deadline, now, first = 0, last = 0;
+	int64_t left;
+	int i, ret;
+
+	interval = (struct histogram *)malloc(sizeof(*interval));
+	if (!interval)
+		return -ENOMEM;
+
+	hist_init(interval);
+	memset(&parser, 0, sizeof(parser));
+	start = now_ns();
+	deadline = start + pdata->duration * NSEC_PER_SEC;
+
+	while (parser.breaks < (uint64_t)pdata->count) {
+		left = deadline - now_ns();
+		if (left <= 0)
+			break;
+
+		ret = read_breaks(pdata, &parser,
+			(left + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC, &now);
+		if (ret == -ETIMEDOUT)
+			break;
+		if (ret < 0)
+			goto e_exit;
+
+		for (i = 0; i < ret; i++) {
+			if (last)
+				hist_record(interval, now - last);
+			else
+				first = now;
+			printf("BREAK %6" PRIu64 " at %10.6f s, %+10.3f ms\n",
+				parser.breaks - ret + i + 1,
+				(double)(now - start) / NSEC_PER_SEC,
+				last ? (double)(now - last) / NSEC_PER_MSEC : 0);
+			last = now;
+		}
+	}
+
+	printf("Breaks: %" PRIu64 ", %.2f per second, %" PRIu64 " errors, %"
+		PRIu64 " data bytes\n", parser.breaks, last > first ?
+		(double)(parser.breaks - 1) * NSEC_PER_SEC / (last - first) : 0,
+		parser.errors, parser.bytes);
+	if (interval->total)
+		hist_print(interval, "Interval", stdout);
+
+	results_set_u64(results, "breaks", parser.breaks);
+	results_set_double(results, "breaks_per_sec", last > first ?
+		(double)(parser.breaks - 1) * NSEC_PER_SEC / (last - first) : 0);
+	results_set_u64(results, "rx_bytes", parser.bytes);
+	results_set_u64(results, "errors", parser.errors);
+	if (interval->total)
+		results_set_hist(results, "interval", interval);
+	ret = 0;
+
+e_exit:
+	free(interval);
+	return ret;
+}
+
+/* Sends a break and waits for the peer to echo it */
+static int break_pingpong(struct break_detect_data *pdata,
+		struct results *results)
+{
+	struct parmrk_parser parser;
+	struct histogram *rtt;
+	uint64_t start, when, lost = 0;
+	int i, ret = 0;
+
+	rtt = (struct histogram *)malloc(sizeof(*rtt));
+	if (!rtt)
+		return -ENOMEM;
+
+	hist_init(rtt);
+	memset(&parser, 0, sizeof(parser));
+
+	for (i = 0; i < pdata->count; i++) {
+		start = now_ns();
+		ret = send_break(pdata->fd, pdata->width_us);
+		if (ret)
+			goto e_exit;
+
+		do {
+			ret = read_breaks(pdata, &parser,
+				BREAK_DETECT_TIMEOUT_MS, &when);
+		} while (ret == 0);
+
+		if (ret == -ETIMEDOUT) {
+			lost++;
+			continue;
+		}
+		if (ret < 0)
+			goto e_exit;
+
+		hist_record(rtt, when - start);
+	}
+
+	if (rtt->total) {
+		hist_print(rtt, "Break RTT", stdout);
+		printf("One way, including one break width: %.1f usec "
+			"(p50 / 2)\n", (double)hist_percentile(rtt, 50.0) / 2 /
+			NSEC_PER_USEC);
+	}
+	printf("Sent %d breaks, %" PRIu64 " lost, %" PRIu64 " errors\n",
+		pdata->count, lost, parser.errors);
+
+	results_set_u64(results, "breaks", pdata->count);
+	results_set_u64(results, "lost", lost);
+	results_set_u64(results, "errors", lost + parser.errors);
+	results_set_hist(results, "rtt", rtt);
+	ret = 0;
+
+e_exit:
+	free(rtt);
+	return ret;
+}
+
+/* Echoes breaks until none arrived for a while */
+static int break_echo(struct break_detect_data *pdata,
+		struct results *results)
+{
+	struct parmrk_parser parser;
+	uint64_t when;
+	int i, breaks, ret;
+
+	memset(&parser, 0, sizeof(parser));
+
+	while (1) {
+		breaks = read_breaks(pdata, &parser, parser.breaks ?
+			2 * BREAK_DETECT_TIMEOUT_MS :
+			BREAK_DETECT_START_TIMEOUT_MS, &when);
+		if (breaks == -ETIMEDOUT)
+			break;
+		if (breaks < 0)
+			return breaks;
+
+		for (i = 0; i < breaks; i++) {
+			ret = send_break(pdata->fd, pdata->width_us);
+			if (ret)
+				return ret;
+		}
+	}
+
+	printf("Echoed %" PRIu64 " breaks, %" PRIu64 " errors\n",
+		parser.breaks, parser.errors);
+
+	results_set_u64(results, "breaks", parser.breaks);
+	results_set_u64(results, "errors", parser.errors);
+
+	return parser.breaks ? 0 : -ETIMEDOUT;
+}
+
+static int break_detect_init(struct cmd *cmd, int argc, char *argv[])
+{
+	int ret, c;
+	struct break_detect_data *pdata;
+
+	pdata = (struct break_detect_data *)calloc(1,
+		sizeof(struct break_detect_data));
+	if (!pdata)
+		return -ENOMEM;
+
+	static struct option long_options[] = {
+		{"duration", required_argument, 0, 'd'},
+		{"count", required_argument, 0, 'n'},
+		{"pingpong", no_argument, 0, 'p'},
+		{"echo", no_argument, 0, 'e'},
+		{"width", required_argument, 0, 'w'},
+		{0, 0, 0, 0}
+	};
+
+	pdata->duration = BREAK_DETECT_DURATION;
+	pdata->count = BREAK_DETECT_COUNT;
+	pdata->width_us = BREAK_DETECT_WIDTH_US;
+
+	while (1) {
+		int option_index = 0;
+
+		c = getopt_long(argc, argv, "d:n:pew:", long_options,
+			&option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'd':
+			pdata->duration = atoi(optarg);
+			break;
+		case 'n':
+			pdata->count = atoi(optarg);
+			break;
+		case 'p':
+			pdata->pingpong = 1;
+			break;
+		case 'e':
+			pdata->echo = 1;
+			break;
+		case 'w':
+			pdata->width_us = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "break_detect: Invalid option %s\n",
+				optarg);
+			ret = -EINVAL;
+			goto e_exit;
+		}
+	}
+
+	if (pdata->duration <= 0 || pdata->count <= 0 ||
+			pdata->width_us <= 0) {
+		fprintf(stderr, "break_detect: Invalid parameters\n");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	if (optind != argc - 1) {
+		fprintf(stderr, "Please specify the tty device");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	pdata->fd = cmd_open_port(cmd, argv[optind], 0, 0);
+	if (pdata->fd < 0) {
+		ret = pdata->fd;
+		goto e_exit;
+	}
+
+	/* A break reads as \377 \0 \0 instead of a plain NUL */
+	ret = port_set_iflag(&cmd->port, PARMRK,
+		IGNBRK | BRKINT | IGNPAR | ISTRIP);
+	if (ret)
+		goto e_exit;
+
+	tcflush(pdata->fd, TCIFLUSH);
+
+	cmd->priv = (void *) pdata;
+
+	return 0;
+
+e_exit:
+	free(pdata);
+	return ret;
+}
+
+static int break_detect_exec(struct cmd *cmd)
+{
+	struct break_detect_data *pdata = (struct break_detect_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	if (pdata->echo)
+		return break_echo(pdata, &cmd->results);
+	if (pdata->pingpong)
+		return break_pingpong(pdata, &cmd->results);
+
+	return break_monitor(pdata, &cmd->results);
+}
+
+static int break_detect_cleanup(struct cmd *cmd)
+{
+	struct break_detect_data *pdata = (struct break_detect_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	free(pdata);
+	cmd->priv = NULL;
+
+	return 0;
+}
+
+REGISTER_CMD(
+	break_detect,
+	"Timestamp breaks in a stream, break ping-pong latency",
+	break_detect_help,
+	break_detect_init,
+	break_detect_exec,
+	break_detect_cleanup,
+	.flags = CMD_MULTIPORT
+);
@@ -33,16 +33,59 @@
 #include <unistd.h>
 
 #include "cmd.h"
+#include "histogram.h"
+#include "io.h"
+#include "timeutil.h"
 
 #define MAX_BUFFERS 5
 #define MAX_CHARS   10
 
+#define IOV_BENCH_IOVCNT		8
+#define IOV_BENCH_SEGMENT_SIZE		32
+#define IOV_BENCH_MAX_SEGMENT		65536
+#define IOV_BENCH_BYTES_DEFAULT		65536
+#define IOV_BENCH_TIMEOUT_MS		2000
+
+#define ALIGN_MAX_OFFSET		63
+#define ALIGN_MAX_SIZE			16384
+#define ALIGN_MAX_SIZES			16
+#define ALIGN_SIZES			"1,4,16,64,256,1024,4096"
+#define ALIGN_ROUNDTRIPS		8
+#define ALIGN_TIMEOUT_MS		2000
+
 static const char alignment_help[] = "Usage:\n"
-	"\t uart_test alignment [options] <ttyDevice>\n";
+	"\t uart_test alignment [options] <ttyDevice>\n"
+	"Echoes messages between buffers at every offset from a 64 byte\n"
+	"boundary and reports throughput and round trip latency as an offset\n"
+	"by size matrix, one for each receiver offset.\n"
+	"Options:\n"
+	"\t-r, --receiver\t\trun as receiver\n"
+	"\t-s, --sender\t\trun as sender (default)\n"
+	"\t-o, --offsets <from>:<to>[:<step>]\n"
+	"\t\t\t\tbuffer offsets (default 0:63:1, sender only)\n"
+	"\t-R, --rx-offsets <list>\treceiver buffer offsets, comma separated\n"
+	"\t\t\t\t(default the sender's offset, sender only)\n"
+	"\t-k, --sizes <list>\tmessage sizes (default 1,4,16,64,256,1024,\n"
+	"\t\t\t\t4096, sender only)\n"
+	"\t-n, --count <n>\t\tround trips per cell (default 8)\n";
 
 static const char iovec_help[] = "Usage:\n"
 	"\t uart_test iovec [options] <ttyDevice>\n";
 
+static const char iovec_bench_help[] = "Usage:\n"
+	"\t uart_test iovec_bench [options] <ttyDevice>\n"
+	"Sends frames made of several segments with writev(), then by copying\n"
+	"them into one buffer for write(). The receiver uses readv(), then\n"
+	"read() and a copy into the segments. Throughput and CPU time are\n"
+	"reported for both sides of each method.\n"
+	"Options:\n"
+	"\t-r, --receiver\t\trun as receiver\n"
+	"\t-s, --sender\t\trun as sender (default)\n"
+	"\t-n, --iovcnt <n>\tsegments per frame, up to IOV_MAX (default 8)\n"
+	"\t-k, --segment <bytes>\tsegment size (default 32)\n"
+	"\t-b, --bytes <n>\t\tbytes per method, rounded up to whole frames\n"
+	"\t\t\t\t(default 65536)\n";
+
 struct buffer_data {
 	int receiver;
 	int fd;
@@ -98,14 +141,12 @@ static int buffer_init(struct cmd *cmd, int argc, char *argv[])
 		goto e_exit;
 	}
 
-	pdata->fd = open(argv[optind], O_RDWR | O_NOCTTY);
+	pdata->fd = cmd_open_port(cmd, argv[optind], PORT_FLUSH, 0);
 	if (pdata->fd < 0) {
-		ret = -ENOENT;
+		ret = pdata->fd;
 		goto e_exit;
 	}
 
-	tcflush(pdata->fd, TCIFLUSH);
-
 	cmd->priv = (void *) pdata;
 
 	return 0;
@@ -140,6 +181,8 @@ static int iovec_exec(struct cmd *cmd)
 			goto e_exit;
 		}
 
+		results_set_u64(&cmd->results, "rx_bytes", count);
+
 		if (count != expected_count) {
 			ret = -EINVAL;
 			goto e_exit;
@@ -164,67 +207,886 @@ e_exit:
 		count = writev(pdata->fd, iov, MAX_BUFFERS);
 		if (count < 0)
 			ret = -errno;
+		else
+			results_set_u64(&cmd->results, "tx_bytes", count);
 	}
 
 	return ret;
 }
 
-static int alignment_exec(struct cmd *cmd)
+/*
+ * Frames of iovcnt segments are sent either with one writev() or copied
+ * into a contiguous buffer first, and received either with readv() or
+ * with read() followed by a copy into the segments.
+ */
+enum {
+	IOV_METHOD_VECTOR,
+	IOV_METHOD_COPY,
+	IOV_METHODS
+};
+
+enum {
+	IOV_BENCH_COUNT = 1,
+	IOV_BENCH_SEGMENT,
+	IOV_BENCH_BYTES,
+	IOV_BENCH_STEP,
+	IOV_BENCH_READY,
+	IOV_BENCH_REPORT,
+	IOV_BENCH_DONE
+};
+
+struct iovec_bench_data {
+	int receiver;
+	int fd;
+	int iovcnt;
+	int segment;
+	int bytes;	/* per method, a whole number of frames */
+};
+
+struct iov_stats {
+	uint64_t calls;
+	uint64_t cpu_ns;
+	uint64_t elapsed_ns;
+	uint64_t errors;
+};
+
+static int iovec_bench_init(struct cmd *cmd, int argc, char *argv[])
 {
-	struct buffer_data *pdata = (struct buffer_data *)cmd->priv;
-	char *pbuffer;
-	ssize_t count;
-	int ret = 0;
+	int ret, c, frame;
+	struct iovec_bench_data *pdata;
 
+	pdata = (struct iovec_bench_data *)calloc(1,
+		sizeof(struct iovec_bench_data));
 	if (!pdata)
-		return -EINVAL;
+		return -ENOMEM;
 
-	pbuffer = calloc(1, 100);
+	static struct option long_options[] = {
+		{"receiver", no_argument, 0, 'r'},
+		{"sender", no_argument, 0, 's'},
+		{"iovcnt", required_argument, 0, 'n'},
+		{"segment", required_argument, 0, 'k'},
+		{"bytes", required_argument, 0, 'b'},
+		{0, 0, 0, 0}
+	};
 
-	if (pdata->receiver) {
-		int i;
-		char *send_buf = pbuffer + 3;
+	pdata->iovcnt = IOV_BENCH_IOVCNT;
+	pdata->segment = IOV_BENCH_SEGMENT_SIZE;
+	pdata->bytes = IOV_BENCH_BYTES_DEFAULT;
+
+	while (1) {
+		int option_index = 0;
+
+		c = getopt_long(argc, argv, "rsn:k:b:", long_options,
+			&option_index);
+		if (c == -1)
+			break;
 
-		if (((uintptr_t)send_buf & 0x3) != 3) {
-			fprintf(stderr, "Failed to create un-aligned buffer\n");
+		switch (c) {
+		case 'r':
+			pdata->receiver = 1;
+			break;
+		case 's':
+			pdata->receiver = 0;
+			break;
+		case 'n':
+			pdata->iovcnt = atoi(optarg);
+			break;
+		case 'k':
+			pdata->segment = atoi(optarg);
+			break;
+		case 'b':
+			pdata->bytes = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "iovec_bench: Invalid option %s\n",
+				optarg);
 			ret = -EINVAL;
 			goto e_exit;
 		}
+	}
 
-		count = read(pdata->fd, send_buf, 10);
-		if (count < 0) {
-			ret = -errno;
+	if (pdata->iovcnt <= 0 || pdata->iovcnt > sysconf(_SC_IOV_MAX) ||
+			pdata->segment <= 0 ||
+			pdata->segment > IOV_BENCH_MAX_SEGMENT ||
+			pdata->bytes <= 0) {
+		fprintf(stderr, "iovec_bench: Invalid parameters\n");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	frame = pdata->iovcnt * pdata->segment;
+	pdata->bytes = (pdata->bytes + frame - 1) / frame * frame;
+
+	if (optind != argc - 1) {
+		fprintf(stderr, "Please specify the tty device");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	pdata->fd = cmd_open_port(cmd, argv[optind], PORT_FLUSH, 0);
+	if (pdata->fd < 0) {
+		ret = pdata->fd;
+		goto e_exit;
+	}
+
+	cmd->priv = (void *) pdata;
+
+	return 0;
+
+e_exit:
+	free(pdata);
+	return ret;
+}
+
+/* Segment i of every frame holds a distinct byte value */
+static void iov_fill(struct iovec *iov, int iovcnt)
+{
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		memset(iov[i].iov_base, 'A' + i % 26, iov[i].iov_len);
+}
+
+/* The part of the frame described by iov that starts at off */
+static int iov_at(const struct iovec *iov, int iovcnt, size_t off,
+		struct iovec *out)
+{
+	int i, n = 0;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (off >= iov[i].iov_len) {
+			off -= iov[i].iov_len;
+			continue;
+		}
+		out[n].iov_base = (char *)iov[i].iov_base + off;
+		out[n].iov_len = iov[i].iov_len - off;
+		off = 0;
+		n++;
+	}
+
+	return n;
+}
+
+/* Segments and a contiguous frame, carved from one allocation */
+static char *iov_alloc(struct iovec_bench_data *pdata, struct iovec **iov,
+		struct iovec **cur)
+{
+	size_t frame = (size_t)pdata->iovcnt * pdata->segment;
+	char *mem;
+	int i;
+
+	mem = (char *)malloc(2 * frame);
+	*iov = (struct iovec *)calloc(pdata->iovcnt, sizeof(struct iovec));
+	*cur = (struct iovec *)calloc(pdata->iovcnt, sizeof(struct iovec));
+	if (!mem || !*iov || !*cur) {
+		free(mem);
+		free(*iov);
+		free(*cur);
+		return NULL;
+	}
+
+	for (i = 0; i < pdata->iovcnt; i++) {
+		(*iov)[i].iov_base = mem + frame + (size_t)i * pdata->segment;
+		(*iov)[i].iov_len = pdata->segment;
+	}
+
+	return mem;
+}
+
+static int iov_send(struct iovec_bench_data *pdata, int method,
+		struct iovec *iov, struct iovec *cur, char *frame,
+		struct iov_stats *stats)
+{
+	size_t frame_len = (size_t)pdata->iovcnt * pdata->segment, off;
+	uint64_t sent, start, cpu;
+	ssize_t count;
+	int i, n;
+
+	memset(stats, 0, sizeof(*stats));
+	cpu = thread_cpu_ns();
+	start = now_ns();
+
+	for (sent = 0; sent < (uint64_t)pdata->bytes; sent += frame_len) {
+		if (method == IOV_METHOD_COPY)
+			for (i = 0; i < pdata->iovcnt; i++)
+				memcpy(frame + (size_t)i * pdata->segment,
+					iov[i].iov_base, pdata->segment);
+
+		for (off = 0; off < frame_len; off += count) {
+			if (method == IOV_METHOD_VECTOR) {
+				n = iov_at(iov, pdata->iovcnt, off, cur);
+				count = writev(pdata->fd, cur, n);
+			} else {
+				count = write(pdata->fd, frame + off,
+					frame_len - off);
+			}
+			stats->calls++;
+			if (count < 0) {
+				if (errno != EINTR)
+					return -errno;
+				count = 0;
+			}
+		}
+	}
+
+	/* Include the time needed to drain the kernel buffer */
+	tcdrain(pdata->fd);
+	stats->elapsed_ns = now_ns() - start;
+	stats->cpu_ns = thread_cpu_ns() - cpu;
+
+	return 0;
+}
+
+static int iov_recv(struct iovec_bench_data *pdata, int method,
+		struct iovec *iov, struct iovec *cur, char *frame,
+		struct iov_stats *stats)
+{
+	size_t frame_len = (size_t)pdata->iovcnt * pdata->segment, off;
+	uint64_t received, start, cpu;
+	ssize_t count;
+	char expected;
+	int i, n;
+
+	memset(stats, 0, sizeof(*stats));
+	cpu = thread_cpu_ns();
+	start = now_ns();
+
+	for (received = 0; received < (uint64_t)pdata->bytes;
+			received += frame_len) {
+		for (off = 0; off < frame_len; off += count) {
+			if (method == IOV_METHOD_VECTOR) {
+				n = iov_at(iov, pdata->iovcnt, off, cur);
+				count = readv(pdata->fd, cur, n);
+			} else {
+				count = read(pdata->fd, frame + off,
+					frame_len - off);
+			}
+			stats->calls++;
+			if (count < 0) {
+				if (errno != EINTR)
+					return -errno;
+				count = 0;
+			} else if (count == 0) {
+				/* Hangup, reading again would return 0 */
+				return -EPIPE;
+			}
+		}
+
+		if (method == IOV_METHOD_COPY)
+			for (i = 0; i < pdata->iovcnt; i++)
+				memcpy(iov[i].iov_base,
+					frame + (size_t)i * pdata->segment,
+					pdata->segment);
+
+		/* Only the first and last byte, to keep the checks cheap */
+		for (i = 0; i < pdata->iovcnt; i++) {
+			expected = 'A' + i % 26;
+			if (((char *)iov[i].iov_base)[0] != expected ||
+					((char *)iov[i].iov_base)
+					[pdata->segment - 1] != expected)
+				stats->errors++;
+		}
+	}
+
+	stats->elapsed_ns = now_ns() - start;
+	stats->cpu_ns = thread_cpu_ns() - cpu;
+
+	return 0;
+}
+
+static int iovec_bench_receiver(struct iovec_bench_data *pdata,
+		struct results *results)
+{
+	struct iovec *iov = NULL, *cur = NULL;
+	struct iov_stats stats;
+	char *mem = NULL;
+	int type, arg, ret;
+
+	while (1) {
+		ret = read_msg(pdata->fd, &type, &arg, -1);
+		if (ret)
+			goto e_exit;
+
+		switch (type) {
+		case IOV_BENCH_COUNT:
+			pdata->iovcnt = arg;
+			continue;
+		case IOV_BENCH_SEGMENT:
+			pdata->segment = arg;
+			continue;
+		case IOV_BENCH_BYTES:
+			pdata->bytes = arg;
+			continue;
+		case IOV_BENCH_DONE:
+			ret = 0;
+			goto e_exit;
+		case IOV_BENCH_STEP:
+			break;
+		default:
+			ret = -EPROTO;
 			goto e_exit;
 		}
 
-		for (i = 0; i < 10; i++) {
-			if (send_buf[i] != 'a') {
-				ret = -EINVAL;
+		if (!mem) {
+			if (pdata->iovcnt <= 0 ||
+					pdata->iovcnt > sysconf(_SC_IOV_MAX) ||
+					pdata->segment <= 0 ||
+					pdata->segment > IOV_BENCH_MAX_SEGMENT) {
+				ret = -EPROTO;
+				goto e_exit;
+			}
+			mem = iov_alloc(pdata, &iov, &cur);
+			if (!mem) {
+				ret = -ENOMEM;
 				goto e_exit;
 			}
 		}
-	} else {
-		char *recv_buf = pbuffer + 1;
 
-		if (((uintptr_t)recv_buf & 0x3) != 1) {
-			fprintf(stderr, "Failed to create un-aligned buffer\n");
-			ret = -EINVAL;
+		ret = send_msg(pdata->fd, IOV_BENCH_READY, 0);
+		if (!ret)
+			ret = iov_recv(pdata, arg, iov, cur, mem, &stats);
+		if (ret)
 			goto e_exit;
+
+		results_add_u64(results, "rx_bytes", pdata->bytes);
+		results_add_u64(results, "errors", stats.errors);
+
+		ret = send_msg(pdata->fd, IOV_BENCH_REPORT, stats.calls);
+		if (!ret)
+			ret = send_msg(pdata->fd, IOV_BENCH_REPORT,
+				stats.cpu_ns / NSEC_PER_USEC);
+		if (!ret)
+			ret = send_msg(pdata->fd, IOV_BENCH_REPORT,
+				stats.elapsed_ns / NSEC_PER_USEC);
+		if (!ret)
+			ret = send_msg(pdata->fd, IOV_BENCH_REPORT,
+				stats.errors);
+		if (ret)
+			goto e_exit;
+	}
+
+e_exit:
+	free(mem);
+	free(iov);
+	free(cur);
+	return ret;
+}
+
+static void iov_print(const char *method, const char *side, uint64_t bytes,
+		const struct iov_stats *stats)
+{
+	printf("%-12s %4s %12.0f %10" PRIu64 " %10.1f %10" PRIu64 " %9.2f %8"
+		PRIu64 "\n", method, side, stats->elapsed_ns ?
+		(double)bytes * NSEC_PER_SEC / stats->elapsed_ns : 0,
+		stats->calls, (double)bytes / stats->calls,
+		(uint64_t)(stats->cpu_ns / NSEC_PER_USEC),
+		(double)stats->cpu_ns / bytes, stats->errors);
+}
+
+static int iovec_bench_sender(struct iovec_bench_data *pdata,
+		struct results *results)
+{
+	static const char *const tx_names[] = { "writev", "copy+write" };
+	static const char *const rx_names[] = { "readv", "read+copy" };
+	static const char *const metrics[] = { "vector", "copy" };
+	struct iovec *iov, *cur;
+	struct iov_stats tx, rx;
+	char name[RESULTS_NAME_LEN];
+	int values[4];
+	int method, i, ret;
+	char *mem;
+
+	mem = iov_alloc(pdata, &iov, &cur);
+	if (!mem)
+		return -ENOMEM;
+	iov_fill(iov, pdata->iovcnt);
+
+	ret = send_msg(pdata->fd, IOV_BENCH_COUNT, pdata->iovcnt);
+	if (!ret)
+		ret = send_msg(pdata->fd, IOV_BENCH_SEGMENT, pdata->segment);
+	if (!ret)
+		ret = send_msg(pdata->fd, IOV_BENCH_BYTES, pdata->bytes);
+	if (ret)
+		goto e_exit;
+
+	printf("%d segments of %d bytes, %d bytes per method\n",
+		pdata->iovcnt, pdata->segment, pdata->bytes);
+	printf("%-12s %4s %12s %10s %10s %10s %9s %8s\n", "Method", "Side",
+		"Bytes/s", "Calls", "B/call", "CPU(us)", "CPU ns/B", "Errors");
+
+	for (method = 0; method < IOV_METHODS; method++) {
+		ret = send_msg(pdata->fd, IOV_BENCH_STEP, method);
+		if (!ret)
+			ret = expect_msg(pdata->fd, IOV_BENCH_READY, NULL,
+				IOV_BENCH_TIMEOUT_MS);
+		if (!ret)
+			ret = iov_send(pdata, method, iov, cur, mem, &tx);
+		for (i = 0; !ret && i < 4; i++)
+			ret = expect_msg(pdata->fd, IOV_BENCH_REPORT,
+				&values[i], IOV_BENCH_TIMEOUT_MS);
+		if (ret)
+			goto e_exit;
+
+		memset(&rx, 0, sizeof(rx));
+		rx.calls = (uint32_t)values[0];
+		rx.cpu_ns = (uint64_t)(uint32_t)values[1] * NSEC_PER_USEC;
+		rx.elapsed_ns = (uint64_t)(uint32_t)values[2] * NSEC_PER_USEC;
+		rx.errors = (uint32_t)values[3];
+
+		iov_print(tx_names[method], "TX", pdata->bytes, &tx);
+		iov_print(rx_names[method], "RX", pdata->bytes, &rx);
+
+		snprintf(name, sizeof(name), "tx_%s", metrics[method]);
+		results_set_rate(results, name, pdata->bytes, tx.elapsed_ns);
+		snprintf(name, sizeof(name), "tx_%s_cpu_ns", metrics[method]);
+		results_set_u64(results, name, tx.cpu_ns);
+		snprintf(name, sizeof(name), "rx_%s_cpu_ns", metrics[method]);
+		results_set_u64(results, name, rx.cpu_ns);
+		results_add_u64(results, "tx_bytes", pdata->bytes);
+		results_add_u64(results, "errors", rx.errors);
+	}
+
+	ret = send_msg(pdata->fd, IOV_BENCH_DONE, 0);
+
+e_exit:
+	free(mem);
+	free(iov);
+	free(cur);
+	return ret;
+}
+
+static int iovec_bench_exec(struct cmd *cmd)
+{
+	struct iovec_bench_data *pdata =
+		(struct iovec_bench_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	if (pdata->receiver)
+		return iovec_bench_receiver(pdata, &cmd->results);
+
+	return iovec_bench_sender(pdata, &cmd->results);
+}
+
+static int iovec_bench_cleanup(struct cmd *cmd)
+{
+	struct iovec_bench_data *pdata =
+		(struct iovec_bench_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	free(pdata);
+	cmd->priv = NULL;
+	return 0;
+}
+
+enum {
+	ALIGN_COUNT = 1,
+	ALIGN_CELL,
+	ALIGN_READY,
+	ALIGN_DONE
+};
+
+struct alignment_data {
+	int receiver;
+	int fd;
+	int count;
+	int off_from;
+	int off_to;
+	int off_step;
+	int rx_offsets[ALIGN_MAX_OFFSET + 1];
+	int nrx;		/* 0 uses the sender's offset on both ends */
+	int sizes[ALIGN_MAX_SIZES];
+	int nsizes;
+};
+
+static int parse_list(const char *list, int min, int max, int *values,
+		int nmax, int *count)
+{
+	char *copy, *token, *end, *saveptr = NULL;
+	long value;
+	int ret = 0;
+
+	copy = strdup(list);
+	if (!copy)
+		return -ENOMEM;
+
+	*count = 0;
+	for (token = strtok_r(copy, ",", &saveptr); token;
+			token = strtok_r(NULL, ",", &saveptr)) {
+		value = strtol(token, &end, 10);
+		if (end == token || *end || value < min || value > max ||
+				*count == nmax) {
+			ret = -EINVAL;
+			break;
 		}
+		values[(*count)++] = value;
+	}
 
-		memset(recv_buf, 'a', 99);
-		count = write(pdata->fd, recv_buf, 10);
-		if (count < 0) {
-			ret = -errno;
+	if (!*count)
+		ret = -EINVAL;
+
+	free(copy);
+	return ret;
+}
+
+static int alignment_init(struct cmd *cmd, int argc, char *argv[])
+{
+	const char *sizes = ALIGN_SIZES, *rx_offsets = NULL;
+	struct alignment_data *pdata;
+	int ret, c;
+
+	pdata = (struct alignment_data *)calloc(1,
+		sizeof(struct alignment_data));
+	if (!pdata)
+		return -ENOMEM;
+
+	static struct option long_options[] = {
+		{"receiver", no_argument, 0, 'r'},
+		{"sender", no_argument, 0, 's'},
+		{"offsets", required_argument, 0, 'o'},
+		{"rx-offsets", required_argument, 0, 'R'},
+		{"sizes", required_argument, 0, 'k'},
+		{"count", required_argument, 0, 'n'},
+		{0, 0, 0, 0}
+	};
+
+	pdata->count = ALIGN_ROUNDTRIPS;
+	pdata->off_from = 0;
+	pdata->off_to = ALIGN_MAX_OFFSET;
+	pdata->off_step = 1;
+
+	while (1) {
+		int option_index = 0;
+
+		c = getopt_long(argc, argv, "rso:R:k:n:", long_options,
+			&option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'r':
+			pdata->receiver = 1;
+			break;
+		case 's':
+			pdata->receiver = 0;
+			break;
+		case 'o':
+			if (sscanf(optarg, "%d:%d:%d", &pdata->off_from,
+					&pdata->off_to, &pdata->off_step) < 2) {
+				ret = -EINVAL;
+				goto e_exit;
+			}
+			break;
+		case 'R':
+			rx_offsets = optarg;
+			break;
+		case 'k':
+			sizes = optarg;
+			break;
+		case 'n':
+			pdata->count = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "alignment: Invalid option %s\n",
+				optarg);
+			ret = -EINVAL;
 			goto e_exit;
 		}
 	}
 
+	if (parse_list(sizes, 1, ALIGN_MAX_SIZE, pdata->sizes,
+				ALIGN_MAX_SIZES, &pdata->nsizes) ||
+			(rx_offsets && parse_list(rx_offsets, 0,
+				ALIGN_MAX_OFFSET, pdata->rx_offsets,
+				ALIGN_MAX_OFFSET + 1, &pdata->nrx)) ||
+			pdata->count <= 0 || pdata->off_from < 0 ||
+			pdata->off_to > ALIGN_MAX_OFFSET ||
+			pdata->off_to < pdata->off_from ||
+			pdata->off_step <= 0) {
+		fprintf(stderr, "alignment: Invalid parameters\n");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	if (optind != argc - 1) {
+		fprintf(stderr, "Please specify the tty device");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	pdata->fd = cmd_open_port(cmd, argv[optind], PORT_FLUSH, 0);
+	if (pdata->fd < 0) {
+		ret = pdata->fd;
+		goto e_exit;
+	}
+
+	cmd->priv = (void *) pdata;
+
+	return 0;
+
 e_exit:
-	free(pbuffer);
+	free(pdata);
 	return ret;
 }
 
+/* Cache line aligned, so that offset 0 is aligned for any DMA engine */
+static char *align_alloc(void)
+{
+	void *buf;
+
+	if (posix_memalign(&buf, ALIGN_MAX_OFFSET + 1,
+			ALIGN_MAX_SIZE + ALIGN_MAX_OFFSET + 1))
+		return NULL;
+
+	return (char *)buf;
+}
+
+/* Echoes count messages of the given size from the given offset */
+static int alignment_receiver(struct alignment_data *pdata,
+		struct results *results)
+{
+	int type, arg, offset, size, i, ret;
+	char *buf;
+
+	buf = align_alloc();
+	if (!buf)
+		return -ENOMEM;
+
+	while (1) {
+		ret = read_msg(pdata->fd, &type, &arg, -1);
+		if (ret)
+			break;
+
+		if (type == ALIGN_DONE)
+			break;
+		if (type == ALIGN_COUNT) {
+			pdata->count = arg;
+			continue;
+		}
+
+		offset = arg >> 16;
+		size = arg & 0xffff;
+		if (type != ALIGN_CELL || offset > ALIGN_MAX_OFFSET ||
+				size <= 0 || size > ALIGN_MAX_SIZE) {
+			ret = -EPROTO;
+			break;
+		}
+
+		ret = send_msg(pdata->fd, ALIGN_READY, 0);
+		for (i = 0; !ret && i < pdata->count; i++) {
+			ret = read_full(pdata->fd, buf + offset, size,
+				ALIGN_TIMEOUT_MS);
+			if (!ret)
+				ret = write_full(pdata->fd, buf + offset, size);
+		}
+		if (ret)
+			break;
+
+		results_add_u64(results, "rx_bytes",
+			(uint64_t)pdata->count * size);
+		results_add_u64(results, "tx_bytes",
+			(uint64_t)pdata->count * size);
+	}
+
+	free(buf);
+	return ret;
+}
+
+static int alignment_cell(struct alignment_data *pdata, char *tx, char *rx,
+		int offset, int rx_offset, int size, struct histogram *rtt,
+		uint64_t *elapsed, uint64_t *errors)
+{
+	uint64_t start, sent;
+	int i, ret;
+
+	/* The receiver only needs its own offset */
+	ret = send_msg(pdata->fd, ALIGN_CELL, rx_offset << 16 | size);
+	if (!ret)
+		ret = expect_msg(pdata->fd, ALIGN_READY, NULL,
+			ALIGN_TIMEOUT_MS);
+	if (ret)
+		return ret;
+
+	hist_init(rtt);
+	start = now_ns();
+
+	for (i = 0; i < pdata->count; i++) {
+		sent = now_ns();
+		ret = write_full(pdata->fd, tx + offset, size);
+		if (!ret)
+			ret = read_full(pdata->fd, rx + offset, size,
+				ALIGN_TIMEOUT_MS);
+		if (ret)
+			return ret;
+
+		hist_record(rtt, now_ns() - sent);
+		if (memcmp(tx + offset, rx + offset, size))
+			(*errors)++;
+	}
+
+	*elapsed = now_ns() - start;
+
+	return 0;
+}
+
+static void alignment_print(struct alignment_data *pdata,
+		const double *matrix)
+{
+	int i, j, rows;
+
+	rows = (pdata->off_to - pdata->off_from) / pdata->off_step + 1;
+
+	printf("%6s", "Offset");
+	for (j = 0; j < pdata->nsizes; j++)
+		printf(" %10d", pdata->sizes[j]);
+	printf("\n");
+
+	for (i = 0; i < rows; i++) {
+		printf("%6d", pdata->off_from + i * pdata->off_step);
+		for (j = 0; j < pdata->nsizes; j++)
+			printf(" %10.1f", matrix[i * pdata->nsizes + j]);
+		printf("\n");
+	}
+}
+
+/*
+ * Runs count round trips for every offset and size and prints a throughput
+ * and a latency matrix for each receiver offset, or a single pair when the
+ * receiver uses the sender's offset.
+ */
+static int alignment_sender(struct alignment_data *pdata,
+		struct results *results)
+{
+	double *rate = NULL, *latency = NULL, worst = 0, rel;
+	struct histogram *rtt = NULL;
+	char *tx = NULL, *rx = NULL;
+	uint64_t elapsed, errors = 0, bytes = 0;
+	int i, j, k, rows, cells, planes, offset, rx_offset, size, ret;
+	double *plane_rate, *plane_latency;
+	char title[64];
+
+	rows = (pdata->off_to - pdata->off_from) / pdata->off_step + 1;
+	planes = pdata->nrx ? pdata->nrx : 1;
+	cells = rows * pdata->nsizes;
+
+	rate = (double *)calloc(planes * cells, sizeof(double));
+	latency = (double *)calloc(planes * cells, sizeof(double));
+	rtt = (struct histogram *)malloc(sizeof(*rtt));
+	tx = align_alloc();
+	rx = align_alloc();
+	if (!rate || !latency || !rtt || !tx || !rx) {
+		ret = -ENOMEM;
+		goto e_exit;
+	}
+
+	for (i = 0; i < ALIGN_MAX_SIZE + ALIGN_MAX_OFFSET + 1; i++)
+		tx[i] = i * 7;
+
+	ret = send_msg(pdata->fd, ALIGN_COUNT, pdata->count);
+	if (ret)
+		goto e_exit;
+
+	for (k = 0; k < planes; k++) {
+		plane_rate = rate + k * cells;
+		plane_latency = latency + k * cells;
+
+		for (i = 0; i < rows; i++) {
+			offset = pdata->off_from + i * pdata->off_step;
+			rx_offset = pdata->nrx ? pdata->rx_offsets[k] : offset;
+
+			for (j = 0; j < pdata->nsizes; j++) {
+				size = pdata->sizes[j];
+
+				ret = alignment_cell(pdata, tx, rx, offset,
+					rx_offset, size, rtt, &elapsed,
+					&errors);
+				if (ret)
+					goto e_exit;
+
+				/* Both directions of every round trip */
+				plane_rate[i * pdata->nsizes + j] =
+					(double)2 * size * pdata->count *
+					NSEC_PER_SEC / elapsed;
+				plane_latency[i * pdata->nsizes + j] =
+					(double)hist_percentile(rtt, 50.0) /
+					NSEC_PER_USEC;
+				bytes += (uint64_t)pdata->count * size;
+			}
+		}
+	}
+
+	ret = send_msg(pdata->fd, ALIGN_DONE, 0);
+	if (ret)
+		goto e_exit;
+
+	for (k = 0; k < planes; k++) {
+		if (pdata->nrx)
+			snprintf(title, sizeof(title), ", receiver offset %d",
+				pdata->rx_offsets[k]);
+		else
+			title[0] = '\0';
+
+		printf("Throughput (bytes/s)%s\n", title);
+		alignment_print(pdata, rate + k * cells);
+		printf("Round trip p50 (usec)%s\n", title);
+		alignment_print(pdata, latency + k * cells);
+	}
+
+	/* Worst throughput of any cell relative to the first offset */
+	for (k = 0; k < planes; k++) {
+		plane_rate = rate + k * cells;
+		for (i = 0; i < cells; i++) {
+			rel = plane_rate[i] / plane_rate[i % pdata->nsizes];
+			if (!worst || rel < worst)
+				worst = rel;
+		}
+	}
+	printf("Slowest offset reaches %.1f%% of the throughput at offset %d, "
+		"%" PRIu64 " errors\n", worst * 100, pdata->off_from, errors);
+
+	results_set_u64(results, "cells", planes * cells);
+	results_set_u64(results, "tx_bytes", bytes);
+	results_set_u64(results, "rx_bytes", bytes);
+	results_set_u64(results, "errors", errors);
+	results_set_double(results, "worst_rel_throughput", worst);
+
+e_exit:
+	free(rate);
+	free(latency);
+	free(rtt);
+	free(tx);
+	free(rx);
+	return ret;
+}
+
+static int alignment_exec(struct cmd *cmd)
+{
+	struct alignment_data *pdata = (struct alignment_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	if (pdata->receiver)
+		return alignment_receiver(pdata, &cmd->results);
+
+	return alignment_sender(pdata, &cmd->results);
+}
+
+static int alignment_cleanup(struct cmd *cmd)
+{
+	struct alignment_data *pdata = (struct alignment_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	free(pdata);
+	cmd->priv = NULL;
+	return 0;
+}
+
 static int buffer_cleanup(struct cmd *cmd)
 {
 	struct ping_data *pdata = (struct ping_data *)cmd->priv;
@@ -243,14 +1105,29 @@ REGISTER_CMD(
 	iovec_help,
 	buffer_init,
 	iovec_exec,
-	buffer_cleanup
+	buffer_cleanup,
+	.flags = CMD_MULTIPORT,
+	.peer_opt = "-r"
+);
+
+REGISTER_CMD(
+	iovec_bench,
+	"writev/readv against contiguous copies",
+	iovec_bench_help,
+	iovec_bench_init,
+	iovec_bench_exec,
+	iovec_bench_cleanup,
+	.flags = CMD_MULTIPORT,
+	.peer_opt = "-r"
 );
 
 REGISTER_CMD(
 	alignment,
 	"alignment test over a serial line",
 	alignment_help,
-	buffer_init,
+	alignment_init,
 	alignment_exec,
-	buffer_cleanup
+	alignment_cleanup,
+	.flags = CMD_MULTIPORT,
+	.peer_opt = "-r"
 );
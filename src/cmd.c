@@ -23,10 +23,30 @@
  */
 
 #include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "cmd.h"
+#include "results.h"
+#include "runner.h"
+#include "timeutil.h"
+#include "transport.h"
+
+#define CMD_MAX_HELD	64
+
+struct held_port {
+	char *path;
+	struct port port;
+	struct tty_state tty;
+};
+
+/* Ports kept open between commands, held_count is -1 when not holding */
+static struct held_port held[CMD_MAX_HELD];
+static int held_count = -1;
+static pthread_mutex_t held_lock = PTHREAD_MUTEX_INITIALIZER;
 
 struct cmd *find_cmd(const char *name)
 {
@@ -40,45 +60,222 @@ struct cmd *find_cmd(const char *name)
 	return NULL;
 }
 
-int execute_cmd(struct cmd *p_cmd, int argc, char *argv[])
+int init_cmd(struct cmd *p_cmd, int argc, char *argv[])
 {
 	int ret = 0;
 
+	results_clear(&p_cmd->results);
+	icount_init(&p_cmd->icount);
+	tty_state_init(&p_cmd->tty);
+	port_init(&p_cmd->port);
+
+	/* Commands parse their own options, restart getopt from scratch */
+	optind = 0;
+
 	if (p_cmd->init) {
 		ret = p_cmd->init(p_cmd, argc, argv);
 		if (ret != 0) {
 			fprintf(stderr, "%s: init returned %d\n", p_cmd->name, ret);
+			icount_detach(&p_cmd->icount);
+			tty_state_restore(&p_cmd->tty);
+			port_close(&p_cmd->port);
 			return ret;
 		}
 	}
 
+	return 0;
+}
+
+int finish_cmd(struct cmd *p_cmd)
+{
+	uint64_t start;
+	int ret = 0, cleanup_ret;
+
+	icount_begin(&p_cmd->icount);
+	start = now_ns();
+
 	if (p_cmd->exec) {
 		ret = p_cmd->exec(p_cmd);
-		if (ret != 0) {
+		if (ret != 0)
 			fprintf(stderr, "%s: execute returned %d\n", p_cmd->name, ret);
-			return ret;
-		}
 	}
 
+	/* A failed exec may still have threads and buffers to release */
 	if (p_cmd->cleanup) {
-		ret = p_cmd->cleanup(p_cmd);
-		if (ret != 0) {
-			fprintf(stderr, "%s: cleanup returned %d\n", p_cmd->name, ret);
-			return ret;
+		cleanup_ret = p_cmd->cleanup(p_cmd);
+		if (cleanup_ret != 0) {
+			fprintf(stderr, "%s: cleanup returned %d\n", p_cmd->name,
+				cleanup_ret);
+			if (!ret)
+				ret = cleanup_ret;
 		}
 	}
 
-	return 0;
+	results_set_u64(&p_cmd->results, "elapsed_ns", now_ns() - start);
+	icount_end(&p_cmd->icount, &p_cmd->results);
+	tty_state_restore(&p_cmd->tty);
+	port_close(&p_cmd->port);
+	return ret;
+}
+
+int cmd_attach_port(struct cmd *p_cmd, const char *path, int interval_ms)
+{
+	int ret;
+
+	ret = tty_state_attach(&p_cmd->tty, &p_cmd->port, &tty_profile);
+	if (ret)
+		fprintf(stderr, "%s: failed to apply the termios profile: %d\n",
+			p_cmd->name, ret);
+
+	icount_attach(&p_cmd->icount, p_cmd->port.fd, path, interval_ms);
+
+	return ret;
+}
+
+void cmd_hold_ports(void)
+{
+	pthread_mutex_lock(&held_lock);
+	if (held_count < 0)
+		held_count = 0;
+	pthread_mutex_unlock(&held_lock);
+}
+
+void cmd_release_ports(void)
+{
+	int i;
+
+	pthread_mutex_lock(&held_lock);
+	for (i = 0; i < held_count; i++) {
+		tty_state_restore(&held[i].tty);
+		port_close(&held[i].port);
+		free(held[i].path);
+	}
+	held_count = -1;
+	pthread_mutex_unlock(&held_lock);
+}
+
+/*
+ * While holding, the first open of a path is kept with the profile
+ * applied and the command gets a duplicate of it. Returns 1 when the
+ * port is a duplicate, 0 when it has to be opened as usual.
+ */
+static int cmd_open_held(struct cmd *p_cmd, const char *path,
+		unsigned int flags)
+{
+	struct held_port *hp;
+	int i, ret = 0;
+
+	pthread_mutex_lock(&held_lock);
+	if (held_count < 0)
+		goto e_unlock;
+
+	for (i = 0; i < held_count; i++)
+		if (strcmp(held[i].path, path) == 0)
+			break;
+
+	hp = &held[i];
+	if (i == held_count) {
+		if (held_count == CMD_MAX_HELD)
+			goto e_unlock;
+
+		ret = port_open(&hp->port, path, flags);
+		if (ret)
+			goto e_unlock;
+
+		hp->path = strdup(path);
+		if (!hp->path) {
+			port_close(&hp->port);
+			ret = -ENOMEM;
+			goto e_unlock;
+		}
+
+		tty_state_init(&hp->tty);
+		ret = tty_state_attach(&hp->tty, &hp->port, &tty_profile);
+		if (ret)
+			fprintf(stderr, "%s: failed to apply the termios profile: %d\n",
+				p_cmd->name, ret);
+		held_count++;
+	}
+
+	ret = port_dup(&p_cmd->port, &hp->port);
+	if (!ret)
+		ret = 1;
+
+e_unlock:
+	pthread_mutex_unlock(&held_lock);
+	return ret;
+}
+
+int cmd_open_port(struct cmd *p_cmd, const char *path, unsigned int flags,
+		int interval_ms)
+{
+	int ret;
+
+	ret = cmd_open_held(p_cmd, path, flags);
+	if (ret > 0) {
+		/* Flushed and set up once, restored by cmd_release_ports */
+		icount_attach(&p_cmd->icount, p_cmd->port.fd, path,
+			interval_ms);
+		return p_cmd->port.fd;
+	}
+
+	if (!ret)
+		ret = port_open(&p_cmd->port, path, flags);
+	if (ret) {
+		fprintf(stderr, "%s: unable to open %s: %d\n", p_cmd->name,
+			path, ret);
+		return ret;
+	}
+
+	cmd_attach_port(p_cmd, path, interval_ms);
+
+	return p_cmd->port.fd;
+}
+
+int execute_cmd(struct cmd *p_cmd, int argc, char *argv[])
+{
+	int ret;
+
+	ret = init_cmd(p_cmd, argc, argv);
+	if (ret == 0)
+		ret = finish_cmd(p_cmd);
+
+	results_emit(p_cmd->name, argc > 1 ? argv[argc - 1] : "", ret,
+		&p_cmd->results);
+
+	return ret;
 }
 
 int run_cmd(int argc, char *argv[])
 {
 	struct cmd *p_cmd = find_cmd(argv[0]);
+	char **ports = NULL;
+	int nports = 0, ret;
 
 	if (!p_cmd) {
 		fprintf(stderr, "Command \"%s\" was not found", argv[0]);
 		return -EINVAL;
 	}
 
+	if (p_cmd->flags & CMD_NOPORT)
+		return execute_cmd(p_cmd, argc, argv);
+
+	if (transport_loopback_enabled())
+		return run_loopback(p_cmd, argc, argv);
+
+	if ((p_cmd->flags & CMD_MULTIPORT) && argc > 1) {
+		ret = expand_ports(argv[argc - 1], &ports, &nports);
+		if (ret)
+			return ret;
+
+		if (nports > 1) {
+			ret = run_multiport(p_cmd, argc, argv, ports, nports);
+			free_ports(ports, nports);
+			return ret;
+		}
+
+		free_ports(ports, nports);
+	}
+
 	return execute_cmd(p_cmd, argc, argv);
 }
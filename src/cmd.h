@@ -24,8 +24,20 @@
 #ifndef CMD_H
 #define CMD_H
 
+#include <stdint.h>
+
+#include "icount.h"
+#include "port.h"
+#include "results.h"
+#include "tty_profile.h"
+
 #define MAX_CMDS 100
 
+/* The command accepts a list or glob of devices as its last argument */
+#define CMD_MULTIPORT	0x1
+/* The command does not take a device, it always runs once in place */
+#define CMD_NOPORT	0x2
+
 struct cmd;
 
 struct cmd {
@@ -35,13 +47,20 @@ struct cmd {
 	const char *name;
 	const char *description;
 	const char *help;
+	unsigned int flags;
+	/* Option which selects the other end, used for loopback runs */
+	const char *peer_opt;
 	void *priv;
+	struct results results;
+	struct icount icount;
+	struct tty_state tty;
+	struct port port;
 };
 
 extern int cmd_count;
 extern struct cmd *cmds[MAX_CMDS];
 
-#define REGISTER_CMD(NAME, DESCRIPTION, HELP, INIT, EXEC, CLEANUP) \
+#define REGISTER_CMD(NAME, DESCRIPTION, HELP, INIT, EXEC, CLEANUP, ...) \
 static struct cmd NAME ## _cmd = {\
 .init = INIT,\
 .exec = EXEC,\
@@ -49,6 +68,7 @@ static struct cmd NAME ## _cmd = {\
 .name = #NAME,\
 .description = DESCRIPTION,\
 .help = HELP, \
+__VA_ARGS__ \
 };\
 static __attribute__((constructor)) void register_ ## NAME(void) \
 { \
@@ -61,4 +81,33 @@ struct cmd *find_cmd(const char *name);
 
 int execute_cmd(struct cmd *p_cmd, int argc, char *argv[]);
 
+int init_cmd(struct cmd *p_cmd, int argc, char *argv[]);
+
+int finish_cmd(struct cmd *p_cmd);
+
+/*
+ * Called once the command's port is open: applies the termios profile
+ * and samples the port counters, every interval_ms if not 0. Both are
+ * undone by finish_cmd after the cleanup, before the port is closed.
+ */
+int cmd_attach_port(struct cmd *p_cmd, const char *path, int interval_ms);
+
+/*
+ * Opens the command's port with the PORT_* flags and attaches it. Returns
+ * the fd or a negative error code, the port is closed by the framework
+ * once the command is done, whether it failed or not.
+ */
+int cmd_open_port(struct cmd *p_cmd, const char *path, unsigned int flags,
+		int interval_ms);
+
+/*
+ * Between cmd_hold_ports() and cmd_release_ports() a device is opened and
+ * set up with the termios profile once, the commands opening it again
+ * get a duplicate and leave its settings in place for the next one. The
+ * settings found on the first open are restored on release.
+ */
+void cmd_hold_ports(void);
+
+void cmd_release_ports(void);
+
 #endif /* CMD_H */
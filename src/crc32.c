@@ -0,0 +1,132 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "crc32.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define HAVE_CRC32C_SSE42
+#endif
+
+#define CRC32C_POLY 0x82f63b78
+
+static uint32_t crc32c_table[8][256];
+
+/* The slicing tables index the bytes in stream order, whatever the host */
+static inline uint32_t get_le32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+		(uint32_t)p[3] << 24;
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+	while (len && ((uintptr_t)p & 7)) {
+		crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+
+	while (len >= 8) {
+		uint32_t lo = get_le32(p) ^ crc, hi = get_le32(p + 4);
+
+		crc = crc32c_table[7][lo & 0xff] ^
+			crc32c_table[6][(lo >> 8) & 0xff] ^
+			crc32c_table[5][(lo >> 16) & 0xff] ^
+			crc32c_table[4][lo >> 24] ^
+			crc32c_table[3][hi & 0xff] ^
+			crc32c_table[2][(hi >> 8) & 0xff] ^
+			crc32c_table[1][(hi >> 16) & 0xff] ^
+			crc32c_table[0][hi >> 24];
+		p += 8;
+		len -= 8;
+	}
+
+	while (len--)
+		crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+#ifdef HAVE_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+	while (len && ((uintptr_t)p & 7)) {
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+
+#ifdef __x86_64__
+	while (len >= 8) {
+		uint64_t v;
+
+		memcpy(&v, p, 8);
+		crc = (uint32_t)_mm_crc32_u64(crc, v);
+		p += 8;
+		len -= 8;
+	}
+#endif
+
+	while (len--)
+		crc = _mm_crc32_u8(crc, *p++);
+
+	return crc;
+}
+#endif
+
+static uint32_t (*crc32c_impl)(uint32_t, const unsigned char *, size_t) =
+	crc32c_sw;
+
+static __attribute__((constructor)) void crc32c_setup(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+		crc32c_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++) {
+		crc = crc32c_table[0][i];
+		for (j = 1; j < 8; j++) {
+			crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+			crc32c_table[j][i] = crc;
+		}
+	}
+
+#ifdef HAVE_CRC32C_SSE42
+	if (__builtin_cpu_supports("sse4.2"))
+		crc32c_impl = crc32c_hw;
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	return ~crc32c_impl(~crc, (const unsigned char *)buf, len);
+}
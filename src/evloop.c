@@ -0,0 +1,321 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "evloop.h"
+#include "timeutil.h"
+
+#define EV_MAX_EVENTS		64
+#define EV_DEFAULT_TIMEOUT_MS	10000
+
+int ev_port_init(struct ev_port *port, int fd, const struct ev_ops *ops,
+		size_t tx_size, size_t rx_size, void *priv)
+{
+	memset(port, 0, sizeof(*port));
+	port->fd = fd;
+	port->ops = ops;
+	port->priv = priv;
+	port->rx_timeout_ms = EV_DEFAULT_TIMEOUT_MS;
+
+	port->fd_flags = fcntl(fd, F_GETFL);
+	if (port->fd_flags < 0)
+		return -errno;
+
+	if (tx_size) {
+		port->tx_buf = malloc(tx_size);
+		if (!port->tx_buf)
+			goto e_nomem;
+		port->tx_size = tx_size;
+		port->tx_active = 1;
+	}
+
+	if (rx_size) {
+		port->rx_buf = malloc(rx_size);
+		if (!port->rx_buf)
+			goto e_nomem;
+		port->rx_size = rx_size;
+		port->rx_active = 1;
+	}
+
+	if (fcntl(fd, F_SETFL, port->fd_flags | O_NONBLOCK) < 0) {
+		ev_port_destroy(port);
+		return -errno;
+	}
+
+	return 0;
+
+e_nomem:
+	ev_port_destroy(port);
+	return -ENOMEM;
+}
+
+void ev_port_destroy(struct ev_port *port)
+{
+	if (port->fd_flags >= 0)
+		fcntl(port->fd, F_SETFL, port->fd_flags);
+
+	free(port->tx_buf);
+	free(port->rx_buf);
+	port->tx_buf = NULL;
+	port->rx_buf = NULL;
+}
+
+int evloop_init(struct evloop *loop)
+{
+	memset(loop, 0, sizeof(*loop));
+
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd < 0)
+		return -errno;
+
+	return 0;
+}
+
+void evloop_destroy(struct evloop *loop)
+{
+	if (loop->epfd >= 0)
+		close(loop->epfd);
+
+	free(loop->ports);
+	loop->ports = NULL;
+	loop->nports = 0;
+}
+
+static uint32_t ev_port_events(struct ev_port *port)
+{
+	return (port->rx_active ? EPOLLIN : 0) |
+		(port->tx_active ? EPOLLOUT : 0);
+}
+
+static void ev_port_fail(struct ev_port *port, int error)
+{
+	port->error = error;
+	port->tx_active = 0;
+	port->rx_active = 0;
+}
+
+/* Syncs the epoll interest set with the state of the port */
+static void ev_port_update(struct evloop *loop, struct ev_port *port)
+{
+	struct epoll_event ev = { .data.ptr = port };
+	uint32_t events = ev_port_events(port);
+
+	if (events == port->events)
+		return;
+
+	if (!events) {
+		epoll_ctl(loop->epfd, EPOLL_CTL_DEL, port->fd, &ev);
+		loop->active--;
+	} else {
+		ev.events = events;
+		if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, port->fd, &ev) < 0) {
+			ev_port_fail(port, -errno);
+			epoll_ctl(loop->epfd, EPOLL_CTL_DEL, port->fd, &ev);
+			loop->active--;
+			events = 0;
+		}
+	}
+
+	port->events = events;
+}
+
+int evloop_add(struct evloop *loop, struct ev_port *port)
+{
+	struct epoll_event ev = { .data.ptr = port };
+	struct ev_port **ports;
+
+	ports = realloc(loop->ports, (loop->nports + 1) * sizeof(*ports));
+	if (!ports)
+		return -ENOMEM;
+
+	loop->ports = ports;
+
+	port->events = ev_port_events(port);
+	port->rx_last_ns = now_ns();
+	if (!port->events)
+		return 0;
+
+	ev.events = port->events;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, port->fd, &ev) < 0)
+		return -errno;
+
+	loop->ports[loop->nports++] = port;
+	loop->active++;
+
+	return 0;
+}
+
+static void ev_port_write(struct ev_port *port)
+{
+	ssize_t ret;
+
+	while (port->tx_active) {
+		if (port->tx_off == port->tx_len) {
+			ret = port->ops->fill(port, port->tx_buf,
+				port->tx_size);
+			if (ret <= 0) {
+				if (ret < 0)
+					ev_port_fail(port, ret);
+				port->tx_active = 0;
+				port->tx_end_ns = now_ns();
+				break;
+			}
+			port->tx_len = ret;
+			port->tx_off = 0;
+		}
+
+		ret = write(port->fd, port->tx_buf + port->tx_off,
+			port->tx_len - port->tx_off);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN) {
+				port->tx_eagain++;
+				break;
+			}
+			ev_port_fail(port, -errno);
+			break;
+		}
+
+		if ((size_t)ret < port->tx_len - port->tx_off)
+			port->tx_partial++;
+
+		port->tx_off += ret;
+		port->tx_bytes += ret;
+	}
+}
+
+static void ev_port_read(struct ev_port *port)
+{
+	ssize_t ret;
+
+	while (port->rx_active) {
+		ret = read(port->fd, port->rx_buf, port->rx_size);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				ev_port_fail(port, -errno);
+			break;
+		}
+		if (ret == 0) {
+			/* Hangup, EPOLLHUP would keep waking us up for nothing */
+			ev_port_fail(port, -EPIPE);
+			break;
+		}
+
+		port->rx_bytes += ret;
+		port->rx_reads++;
+		port->rx_last_ns = now_ns();
+
+		ret = port->ops->consume(port, port->rx_buf, ret);
+		if (ret < 0)
+			ev_port_fail(port, ret);
+		else if (ret > 0)
+			port->rx_active = 0;
+	}
+}
+
+static void ev_port_check_timeout(struct ev_port *port, uint64_t now)
+{
+	int ret;
+
+	if (!port->rx_active ||
+	    now - port->rx_last_ns < port->rx_timeout_ms * NSEC_PER_MSEC)
+		return;
+
+	ret = port->ops->timeout ? port->ops->timeout(port) : -ETIMEDOUT;
+	if (ret < 0)
+		ev_port_fail(port, ret);
+	else if (ret > 0)
+		port->rx_active = 0;
+	else
+		port->rx_last_ns = now;
+}
+
+/* Time until the earliest receive timeout, in milliseconds */
+static int evloop_next_timeout(struct evloop *loop)
+{
+	uint64_t now = now_ns(), deadline, next = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < loop->nports; i++) {
+		struct ev_port *port = loop->ports[i];
+
+		if (!port->rx_active)
+			continue;
+
+		deadline = port->rx_last_ns +
+			port->rx_timeout_ms * NSEC_PER_MSEC;
+		if (deadline < next)
+			next = deadline;
+	}
+
+	if (next == UINT64_MAX)
+		return -1;
+
+	return next > now ? (next - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC : 0;
+}
+
+int evloop_run(struct evloop *loop)
+{
+	struct epoll_event events[EV_MAX_EVENTS];
+	uint64_t now;
+	int i, n;
+
+	while (loop->active) {
+		n = epoll_wait(loop->epfd, events, EV_MAX_EVENTS,
+			evloop_next_timeout(loop));
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		loop->wakeups++;
+
+		for (i = 0; i < n; i++) {
+			struct ev_port *port = events[i].data.ptr;
+
+			if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+				ev_port_read(port);
+			if (events[i].events & EPOLLOUT)
+				ev_port_write(port);
+		}
+
+		now = now_ns();
+		for (i = 0; i < loop->nports; i++) {
+			ev_port_check_timeout(loop->ports[i], now);
+			ev_port_update(loop, loop->ports[i]);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+struct ev_port;
+
+/*
+ * Callbacks driving the per-port sender and receiver state machines.
+ * fill: produce up to len bytes to send. Returns the number of bytes,
+ *	0 when the sender is done or a negative error code.
+ * consume: handle received bytes. Returns 1 when the receiver is done,
+ *	0 to keep receiving or a negative error code.
+ * timeout: called when nothing was received for rx_timeout_ms. Same
+ *	return values as consume.
+ */
+struct ev_ops {
+	ssize_t (*fill)(struct ev_port *port, char *buf, size_t len);
+	int (*consume)(struct ev_port *port, const char *buf, size_t len);
+	int (*timeout)(struct ev_port *port);
+};
+
+struct ev_port {
+	int fd;
+	int fd_flags;
+	const struct ev_ops *ops;
+	void *priv;
+	int error;
+	uint32_t events;
+
+	int tx_active;
+	char *tx_buf;
+	size_t tx_size;
+	size_t tx_len;
+	size_t tx_off;
+	uint64_t tx_bytes;
+	uint64_t tx_partial;
+	uint64_t tx_eagain;
+	uint64_t tx_end_ns;
+
+	int rx_active;
+	char *rx_buf;
+	size_t rx_size;
+	uint64_t rx_bytes;
+	uint64_t rx_reads;
+	uint64_t rx_last_ns;
+	int rx_timeout_ms;
+};
+
+struct evloop {
+	int epfd;
+	struct ev_port **ports;
+	int nports;
+	int active;
+	uint64_t wakeups;
+};
+
+/* A zero tx_size or rx_size disables that direction */
+int ev_port_init(struct ev_port *port, int fd, const struct ev_ops *ops,
+		size_t tx_size, size_t rx_size, void *priv);
+
+void ev_port_destroy(struct ev_port *port);
+
+int evloop_init(struct evloop *loop);
+
+int evloop_add(struct evloop *loop, struct ev_port *port);
+
+/* Runs until every port is done. Per-port failures are left in port->error */
+int evloop_run(struct evloop *loop);
+
+void evloop_destroy(struct evloop *loop);
+
+#endif /* EVLOOP_H */
@@ -0,0 +1,541 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "cmd.h"
+#include "frame.h"
+#include "histogram.h"
+#include "io.h"
+#include "serial.h"
+#include "timeutil.h"
+#include "tty_profile.h"
+
+#define FLOW_STRESS_DURATION		10
+#define FLOW_STRESS_SIZE		256
+#define FLOW_STRESS_RUN_MS		200
+#define FLOW_STRESS_STALL_MS		100
+#define FLOW_STRESS_BUF_SIZE		4096
+#define FLOW_STRESS_IDLE_MS		1000
+#define FLOW_STRESS_TIMEOUT_MS		2000
+#define FLOW_STRESS_SAMPLE_US		100
+/* Quiet time before the end of a stall that counts as stopped */
+#define FLOW_STRESS_SETTLE_MS		10
+
+static const char flow_stress_help[] = "Usage:\n"
+	"\t uart_test flow_stress [options] <ttyDevice>\n"
+	"Streams frames at full rate with CRTSCTS enabled while the receiver\n"
+	"stalls in a pattern, then verifies that nothing was lost. For every\n"
+	"stall the receiver measures how long data kept arriving and how many\n"
+	"bytes came in after RTS was deasserted.\n"
+	"Options:\n"
+	"\t-r, --receiver\t\trun as receiver\n"
+	"\t-s, --sender\t\trun as sender (default)\n"
+	"\t-d, --duration <sec>\tstream duration (default 10)\n"
+	"\t-k, --size <bytes>\tframe size (default 256)\n"
+	"\t-p, --pattern <run>:<stall>\n"
+	"\t\t\t\treceiver reads for <run> ms, then stalls for\n"
+	"\t\t\t\t<stall> ms (default 200:100, sender only)\n"
+	"\t-j, --jitter <ms>\trandomize every run and stall by up to\n"
+	"\t\t\t\t+/- <ms> (default 0, sender only)\n";
+
+enum {
+	FLOW_SETUP = 1,
+	FLOW_PATTERN,
+	FLOW_READY,
+	FLOW_REPORT
+};
+
+struct flow_stress_data {
+	int receiver;
+	int fd;
+	struct port *port;
+	int duration;
+	int size;
+	int run_ms;
+	int stall_ms;
+	int jitter_ms;
+};
+
+/* What the receiver saw during the stalls */
+struct flow_stall_stats {
+	uint64_t stalls;
+	uint64_t stopped;
+	uint64_t rts_low;
+	uint64_t after_rts;
+	uint64_t after_rts_max;
+	struct histogram stop;
+};
+
+static int flow_stress_init(struct cmd *cmd, int argc, char *argv[])
+{
+	int ret, c;
+	struct flow_stress_data *pdata;
+
+	pdata = (struct flow_stress_data *)calloc(1,
+		sizeof(struct flow_stress_data));
+	if (!pdata)
+		return -ENOMEM;
+
+	static struct option long_options[] = {
+		{"receiver", no_argument, 0, 'r'},
+		{"sender", no_argument, 0, 's'},
+		{"duration", required_argument, 0, 'd'},
+		{"size", required_argument, 0, 'k'},
+		{"pattern", required_argument, 0, 'p'},
+		{"jitter", required_argument, 0, 'j'},
+		{0, 0, 0, 0}
+	};
+
+	pdata->duration = FLOW_STRESS_DURATION;
+	pdata->size = FLOW_STRESS_SIZE;
+	pdata->run_ms = FLOW_STRESS_RUN_MS;
+	pdata->stall_ms = FLOW_STRESS_STALL_MS;
+
+	while (1) {
+		int option_index = 0;
+
+		c = getopt_long(argc, argv, "rsd:k:p:j:", long_options,
+			&option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'r':
+			pdata->receiver = 1;
+			break;
+		case 's':
+			pdata->receiver = 0;
+			break;
+		case 'd':
+			pdata->duration = atoi(optarg);
+			break;
+		case 'k':
+			pdata->size = atoi(optarg);
+			break;
+		case 'p':
+			if (sscanf(optarg, "%d:%d", &pdata->run_ms,
+					&pdata->stall_ms) != 2) {
+				ret = -EINVAL;
+				goto e_exit;
+			}
+			break;
+		case 'j':
+			pdata->jitter_ms = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "flow_stress: Invalid option %s\n",
+				optarg);
+			ret = -EINVAL;
+			goto e_exit;
+		}
+	}
+
+	if (pdata->duration <= 0 || pdata->size < FRAME_OVERHEAD ||
+			pdata->size > FRAME_MAX_SIZE || pdata->run_ms <= 0 ||
+			pdata->run_ms > 0xffff || pdata->stall_ms < 0 ||
+			pdata->stall_ms > 0xffff || pdata->jitter_ms < 0) {
+		fprintf(stderr, "flow_stress: Invalid parameters\n");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	if (optind != argc - 1) {
+		fprintf(stderr, "Please specify the tty device");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	pdata->fd = cmd_open_port(cmd, argv[optind], PORT_FLUSH, 0);
+	if (pdata->fd < 0) {
+		ret = pdata->fd;
+		goto e_exit;
+	}
+	pdata->port = &cmd->port;
+
+	cmd->priv = (void *) pdata;
+
+	return 0;
+
+e_exit:
+	free(pdata);
+	return ret;
+}
+
+static int jitter(int base_ms, int jitter_ms, unsigned int *seed)
+{
+	int value;
+
+	if (!jitter_ms)
+		return base_ms;
+
+	value = base_ms + rand_r(seed) % (2 * jitter_ms + 1) - jitter_ms;
+	return value < 0 ? 0 : value;
+}
+
+/*
+ * Bytes received so far: the driver's counter where there is one, as it
+ * keeps counting once the line discipline is full, otherwise the input
+ * queue.
+ */
+static int rx_count(int fd, int icount, uint64_t *count)
+{
+	struct serial_counters counters;
+	int queued, ret;
+
+	if (icount) {
+		ret = serial_get_counters(fd, &counters);
+		if (ret)
+			return ret;
+		*count = counters.rx;
+		return 0;
+	}
+
+	if (ioctl(fd, FIONREAD, &queued) < 0)
+		return -errno;
+	*count = queued;
+	return 0;
+}
+
+/* Watches the input while nothing is read */
+static void stall(struct flow_stress_data *pdata, int stall_ms, int icount,
+		struct flow_stall_stats *stats)
+{
+	struct timespec sample = ns_to_ts(FLOW_STRESS_SAMPLE_US *
+		NSEC_PER_USEC);
+	uint64_t start, end, now, last_change, count, last_count, rts_count;
+	int modem, rts_low = 0;
+
+	start = now_ns();
+	end = start + stall_ms * NSEC_PER_MSEC;
+	last_change = start;
+
+	if (rx_count(pdata->fd, icount, &last_count))
+		return;
+	rts_count = last_count;
+
+	for (now = start; now < end; now = now_ns()) {
+		if (rx_count(pdata->fd, icount, &count))
+			return;
+		if (count != last_count) {
+			last_count = count;
+			last_change = now;
+		}
+
+		if (!rts_low && ioctl(pdata->fd, TIOCMGET, &modem) == 0 &&
+				!(modem & TIOCM_RTS)) {
+			rts_low = 1;
+			rts_count = count;
+		}
+
+		nanosleep(&sample, NULL);
+	}
+
+	stats->stalls++;
+	if (last_change + FLOW_STRESS_SETTLE_MS * NSEC_PER_MSEC <= end) {
+		stats->stopped++;
+		hist_record(&stats->stop, last_change - start);
+	}
+
+	if (rts_low) {
+		stats->rts_low++;
+		count = (uint32_t)(last_count - rts_count);
+		stats->after_rts += count;
+		if (count > stats->after_rts_max)
+			stats->after_rts_max = count;
+	}
+}
+
+static int send_report(int fd, const struct frame_stats *frames,
+		uint64_t bytes)
+{
+	int values[] = {
+		frames->frames,
+		frames->lost,
+		frames->corrupted,
+		frames->out_of_order,
+		bytes >> 32,
+		bytes,
+	};
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		ret = send_msg(fd, FLOW_REPORT, values[i]);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int flow_stress_receiver(struct flow_stress_data *pdata,
+		struct results *results)
+{
+	struct serial_counters counters;
+	struct flow_stall_stats *stats;
+	struct frame_parser *parser;
+	struct pollfd pfd;
+	uint64_t start, first = 0, last = 0, bytes = 0, run_end, now;
+	unsigned int seed = now_ns();
+	int arg, icount, timeout, ret;
+	char *buf;
+	ssize_t count;
+
+	stats = (struct flow_stall_stats *)calloc(1, sizeof(*stats));
+	parser = (struct frame_parser *)malloc(sizeof(*parser));
+	buf = (char *)malloc(FLOW_STRESS_BUF_SIZE);
+	if (!stats || !parser || !buf) {
+		ret = -ENOMEM;
+		goto e_exit;
+	}
+
+	hist_init(&stats->stop);
+	frame_parser_init(parser);
+	icount = serial_get_counters(pdata->fd, &counters) == 0;
+
+	ret = expect_msg(pdata->fd, FLOW_SETUP, &pdata->duration, -1);
+	if (!ret)
+		ret = expect_msg(pdata->fd, FLOW_PATTERN, &arg, -1);
+	if (!ret) {
+		pdata->run_ms = (uint32_t)arg >> 16;
+		pdata->stall_ms = arg & 0xffff;
+		ret = expect_msg(pdata->fd, FLOW_PATTERN, &pdata->jitter_ms,
+			-1);
+	}
+	if (!ret)
+		ret = tty_profile_apply_flow(pdata->port, TTY_FLOW_RTSCTS);
+	if (!ret)
+		ret = send_msg(pdata->fd, FLOW_READY, 0);
+	if (ret)
+		goto e_exit;
+
+	pfd.fd = pdata->fd;
+	pfd.events = POLLIN;
+	start = now_ns();
+	last = start;
+
+	while (1) {
+		run_end = now_ns() + jitter(pdata->run_ms, pdata->jitter_ms,
+			&seed) * NSEC_PER_MSEC;
+
+		while ((now = now_ns()) < run_end) {
+			timeout = (run_end - now + NSEC_PER_MSEC - 1) /
+				NSEC_PER_MSEC;
+			ret = poll(&pfd, 1, timeout);
+			if (ret < 0 && errno != EINTR) {
+				ret = -errno;
+				goto e_exit;
+			}
+			if (ret <= 0)
+				continue;
+
+			count = read(pdata->fd, buf, FLOW_STRESS_BUF_SIZE);
+			if (count < 0) {
+				if (errno == EINTR)
+					continue;
+				ret = -errno;
+				goto e_exit;
+			}
+
+			if (!first)
+				first = now_ns();
+			last = now_ns();
+			bytes += count;
+			frame_parser_feed(parser, buf, count);
+		}
+
+		/* The stream is over once the line goes idle */
+		now = now_ns();
+		if (now - start >= pdata->duration * NSEC_PER_SEC &&
+				now - last >= FLOW_STRESS_IDLE_MS * NSEC_PER_MSEC)
+			break;
+
+		stall(pdata, jitter(pdata->stall_ms, pdata->jitter_ms, &seed),
+			icount, stats);
+	}
+
+	printf("Received %" PRIu64 " frames, %" PRIu64 " lost, %" PRIu64
+		" corrupted, %" PRIu64 " out of order, %.0f bytes/s\n",
+		parser->stats.frames, parser->stats.lost,
+		parser->stats.corrupted, parser->stats.out_of_order,
+		last > first ? (double)bytes * NSEC_PER_SEC / (last - first) :
+		0);
+	printf("Stalls: %" PRIu64 ", stopped: %" PRIu64 ", RTS deasserted: %"
+		PRIu64 "\n", stats->stalls, stats->stopped, stats->rts_low);
+	if (stats->stop.total)
+		hist_print(&stats->stop, "Stall to stop", stdout);
+	if (stats->rts_low)
+		printf("After RTS deasserted: %" PRIu64 " bytes, %.1f per "
+			"stall, %" PRIu64 " max\n", stats->after_rts,
+			(double)stats->after_rts / stats->rts_low,
+			stats->after_rts_max);
+	else
+		printf("RTS was never seen deasserted\n");
+
+	results_set_rate(results, "rx", bytes, last - first);
+	results_set_u64(results, "frames", parser->stats.frames);
+	results_set_u64(results, "errors", parser->stats.lost +
+		parser->stats.corrupted + parser->stats.out_of_order);
+	results_set_u64(results, "stalls", stats->stalls);
+	results_set_u64(results, "stalls_stopped", stats->stopped);
+	results_set_u64(results, "rts_deasserted", stats->rts_low);
+	results_set_u64(results, "after_rts_bytes", stats->after_rts);
+	results_set_u64(results, "after_rts_max_bytes", stats->after_rts_max);
+	if (stats->stop.total)
+		results_set_hist(results, "stop", &stats->stop);
+
+	ret = send_report(pdata->fd, &parser->stats, bytes);
+
+e_exit:
+	free(buf);
+	free(parser);
+	free(stats);
+	return ret;
+}
+
+static int flow_stress_sender(struct flow_stress_data *pdata,
+		struct results *results)
+{
+	int values[6];
+	uint64_t start, deadline, elapsed, bytes = 0, received, missing;
+	uint32_t seq = 0;
+	unsigned int i;
+	char *buf;
+	int ret;
+
+	buf = (char *)malloc(pdata->size);
+	if (!buf)
+		return -ENOMEM;
+
+	ret = tty_profile_apply_flow(pdata->port, TTY_FLOW_RTSCTS);
+	if (!ret)
+		ret = send_msg(pdata->fd, FLOW_SETUP, pdata->duration);
+	if (!ret)
+		ret = send_msg(pdata->fd, FLOW_PATTERN,
+			(uint32_t)pdata->run_ms << 16 | pdata->stall_ms);
+	if (!ret)
+		ret = send_msg(pdata->fd, FLOW_PATTERN, pdata->jitter_ms);
+	if (!ret)
+		ret = expect_msg(pdata->fd, FLOW_READY, NULL,
+			FLOW_STRESS_TIMEOUT_MS);
+	if (ret)
+		goto e_exit;
+
+	start = now_ns();
+	deadline = start + pdata->duration * NSEC_PER_SEC;
+
+	while (now_ns() < deadline) {
+		frame_build(buf, pdata->size, seq++);
+		ret = write_full(pdata->fd, buf, pdata->size);
+		if (ret)
+			goto e_exit;
+		bytes += pdata->size;
+	}
+
+	tcdrain(pdata->fd);
+	elapsed = now_ns() - start;
+
+	for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		ret = expect_msg(pdata->fd, FLOW_REPORT, &values[i],
+			FLOW_STRESS_IDLE_MS + pdata->stall_ms +
+			pdata->jitter_ms + FLOW_STRESS_TIMEOUT_MS);
+		if (ret)
+			goto e_exit;
+	}
+
+	received = (uint32_t)values[0];
+	missing = seq > received ? seq - received : 0;
+
+	printf("Sent %" PRIu32 " frames, %" PRIu64 " bytes, %.0f bytes/s\n",
+		seq, bytes, (double)bytes * NSEC_PER_SEC / elapsed);
+	printf("Received %" PRIu64 " frames, %u lost, %u corrupted, %u out "
+		"of order, %" PRIu64 " missing\n", received, values[1],
+		values[2], values[3], missing);
+
+	results_set_rate(results, "tx", bytes, elapsed);
+	results_set_u64(results, "rx_bytes", (uint64_t)(uint32_t)values[4] <<
+		32 | (uint32_t)values[5]);
+	results_set_u64(results, "frames", seq);
+	results_set_u64(results, "errors", missing + (uint32_t)values[1] +
+		(uint32_t)values[2] + (uint32_t)values[3]);
+
+	if (missing || values[1] || values[2] || values[3]) {
+		printf("FAIL: data was lost under flow control\n");
+		ret = -EIO;
+	} else {
+		printf("PASS: no data lost\n");
+	}
+
+e_exit:
+	free(buf);
+	return ret;
+}
+
+static int flow_stress_exec(struct cmd *cmd)
+{
+	struct flow_stress_data *pdata = (struct flow_stress_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	if (pdata->receiver)
+		return flow_stress_receiver(pdata, &cmd->results);
+
+	return flow_stress_sender(pdata, &cmd->results);
+}
+
+static int flow_stress_cleanup(struct cmd *cmd)
+{
+	struct flow_stress_data *pdata = (struct flow_stress_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	free(pdata);
+	cmd->priv = NULL;
+
+	return 0;
+}
+
+REGISTER_CMD(
+	flow_stress,
+	"CRTSCTS streaming with a stalling receiver, no-loss check",
+	flow_stress_help,
+	flow_stress_init,
+	flow_stress_exec,
+	flow_stress_cleanup,
+	.flags = CMD_MULTIPORT,
+	.peer_opt = "-r"
+);
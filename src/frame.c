@@ -0,0 +1,170 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+
+#include "crc32.h"
+#include "frame.h"
+
+int frame_build(void *buf, size_t size, uint32_t seq)
+{
+	unsigned char *p = buf;
+	uint16_t magic, len;
+	uint32_t netseq, crc;
+	size_t i, payload;
+
+	if (size < FRAME_OVERHEAD || size > FRAME_MAX_SIZE)
+		return -EINVAL;
+
+	payload = size - FRAME_OVERHEAD;
+	magic = htons(FRAME_MAGIC);
+	len = htons(payload);
+	netseq = htonl(seq);
+
+	memcpy(p, &magic, 2);
+	memcpy(p + 2, &len, 2);
+	memcpy(p + 4, &netseq, 4);
+
+	for (i = 0; i < payload; i++)
+		p[FRAME_HEADER_SIZE + i] = (unsigned char)(seq + i);
+
+	crc = htonl(crc32c(0, p, FRAME_HEADER_SIZE + payload));
+	memcpy(p + FRAME_HEADER_SIZE + payload, &crc, 4);
+
+	return size;
+}
+
+void frame_parser_init(struct frame_parser *parser)
+{
+	memset(parser, 0, sizeof(*parser));
+}
+
+static void frame_accept(struct frame_parser *parser, uint32_t seq)
+{
+	struct frame_stats *stats = &parser->stats;
+
+	stats->frames++;
+
+	if ((int32_t)(seq - parser->expected_seq) < 0) {
+		stats->out_of_order++;
+		return;
+	}
+
+	/* Corrupted frames already account for part of the gap */
+	if (seq - parser->expected_seq > parser->pending_corrupted)
+		stats->lost += seq - parser->expected_seq -
+			parser->pending_corrupted;
+
+	parser->pending_corrupted = 0;
+	parser->expected_seq = seq + 1;
+}
+
+/* Consumes frames from the start of the buffer. Returns bytes consumed. */
+static size_t frame_parse(struct frame_parser *parser, const unsigned char *p,
+		size_t len)
+{
+	const unsigned char *start = p;
+	uint16_t magic, payload;
+	uint32_t seq, crc;
+	size_t size;
+
+	while (len >= FRAME_HEADER_SIZE) {
+		memcpy(&magic, p, 2);
+		memcpy(&payload, p + 2, 2);
+		payload = ntohs(payload);
+
+		if (ntohs(magic) != FRAME_MAGIC || payload > FRAME_MAX_PAYLOAD) {
+			parser->stats.discarded++;
+			p++;
+			len--;
+			continue;
+		}
+
+		size = FRAME_OVERHEAD + payload;
+		if (len < size)
+			break;
+
+		memcpy(&seq, p + 4, 4);
+		memcpy(&crc, p + FRAME_HEADER_SIZE + payload, 4);
+
+		if (ntohl(crc) != crc32c(0, p, FRAME_HEADER_SIZE + payload)) {
+			parser->stats.corrupted++;
+			parser->pending_corrupted++;
+		} else {
+			frame_accept(parser, ntohl(seq));
+		}
+
+		p += size;
+		len -= size;
+	}
+
+	return p - start;
+}
+
+void frame_parser_feed(struct frame_parser *parser, const void *data,
+		size_t len)
+{
+	const unsigned char *p = data;
+	size_t copy, used;
+
+	/* Complete the frame left over from the previous call */
+	while (parser->len && len) {
+		copy = sizeof(parser->buf) - parser->len;
+		if (copy > len)
+			copy = len;
+
+		memcpy(parser->buf + parser->len, p, copy);
+		parser->len += copy;
+		p += copy;
+		len -= copy;
+
+		used = frame_parse(parser, parser->buf, parser->len);
+		memmove(parser->buf, parser->buf + used, parser->len - used);
+		parser->len -= used;
+
+		/*
+		 * Once only the bytes from this call are left, parse them
+		 * in place instead of copying them around.
+		 */
+		if (parser->len <= copy) {
+			p -= parser->len;
+			len += parser->len;
+			parser->len = 0;
+			break;
+		}
+	}
+
+	if (parser->len)
+		return;
+
+	used = frame_parse(parser, p, len);
+	p += used;
+	len -= used;
+
+	memcpy(parser->buf, p, len);
+	parser->len = len;
+}
@@ -0,0 +1,66 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Frame layout (all fields in network byte order):
+ *	magic(2) | payload length(2) | sequence number(4) | payload | crc32c(4)
+ * The CRC covers the header and the payload.
+ */
+#define FRAME_MAGIC		0xa55a
+#define FRAME_HEADER_SIZE	8
+#define FRAME_TRAILER_SIZE	4
+#define FRAME_OVERHEAD		(FRAME_HEADER_SIZE + FRAME_TRAILER_SIZE)
+#define FRAME_MAX_SIZE		4096
+#define FRAME_MAX_PAYLOAD	(FRAME_MAX_SIZE - FRAME_OVERHEAD)
+
+struct frame_stats {
+	uint64_t frames;
+	uint64_t lost;
+	uint64_t corrupted;
+	uint64_t out_of_order;
+	uint64_t discarded;	/* bytes skipped while resynchronizing */
+};
+
+struct frame_parser {
+	unsigned char buf[FRAME_MAX_SIZE];
+	size_t len;
+	uint32_t expected_seq;
+	uint64_t pending_corrupted;
+	struct frame_stats stats;
+};
+
+/* Builds a frame of exactly size bytes into buf. Returns size or -EINVAL. */
+int frame_build(void *buf, size_t size, uint32_t seq);
+
+void frame_parser_init(struct frame_parser *parser);
+
+void frame_parser_feed(struct frame_parser *parser, const void *data,
+		size_t len);
+
+#endif /* FRAME_H */
@@ -34,7 +34,33 @@ void help(void)
 	int i;
 
 	printf("Usage:\n"
-		"\tuart_test <command> <parameters>\n\n"
+		"\tuart_test [global options] <command> <parameters>\n\n"
+		"Global options:\n"
+		"\t-j, --jobs <n>\t\tworker threads for multi-port runs\n"
+		"\t-C, --cpus <list>\tpin ports round robin to CPUs, "
+		"e.g. 0-3,6\n"
+		"\t-F, --format <fmt>\tresults as text (default), json lines "
+		"or csv;\n"
+		"\t\t\t\tthe records go to stdout, the rest to stderr\n"
+		"\t-I, --icount-interval <ms>\n"
+		"\t\t\t\tprint the port interrupt counters every <ms>\n"
+		"\t\t\t\twhile a command runs, on drivers which have them\n"
+		"\t-L, --loopback pty\trun both ends over a pseudo-terminal "
+		"pair,\n"
+		"\t\t\t\tthe device argument is left out\n"
+		"\t-T, --termios <spec>\tline settings applied to every port "
+		"and\n"
+		"\t\t\t\trestored afterwards, comma separated list of\n"
+		"\t\t\t\tnone, raw, cooked, 8N1 style formats,\n"
+		"\t\t\t\tvmin=<n>, vtime=<n>, flow=none|rtscts|xonxoff\n"
+		"\t\t\t\tand low_latency=on|off\n"
+		"\t\t\t\t(default raw,vmin=1,vtime=0, the data format\n"
+		"\t\t\t\tand flow control are kept unless given)\n"
+		"\t-t, --trace <file>\trecord every read, write and ioctl of "
+		"the\n"
+		"\t\t\t\tcommand to a binary file, see trace_stats\n\n"
+		"Multi-port commands accept a comma separated list or glob of "
+		"devices.\n\n"
 		"Supported commands:\n");
 	for (i = 0; i < cmd_count; i++) {
 		printf("\t%s\t%s\n", cmds[i]->name,
@@ -74,5 +100,6 @@ REGISTER_CMD(
 	"displays help (generic or for a specific command)",
 	help_init,
 	help_exec,
-	NULL
+	NULL,
+	.flags = CMD_NOPORT
 );
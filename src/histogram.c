@@ -0,0 +1,120 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "histogram.h"
+#include "timeutil.h"
+
+static const double report_percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+
+static unsigned int value_to_index(uint64_t value)
+{
+	unsigned int msb;
+
+	if (value < HIST_SUB_BUCKETS)
+		return value;
+
+	msb = 63 - __builtin_clzll(value);
+
+	return (msb - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS +
+		(value >> (msb - HIST_SUB_BITS)) - HIST_SUB_BUCKETS;
+}
+
+/* Highest value which maps to the given bucket */
+static uint64_t index_to_value(unsigned int index)
+{
+	unsigned int magnitude = index / HIST_SUB_BUCKETS;
+	uint64_t sub = index % HIST_SUB_BUCKETS;
+
+	if (!magnitude)
+		return sub;
+
+	return ((HIST_SUB_BUCKETS + sub + 1) << (magnitude - 1)) - 1;
+}
+
+void hist_init(struct histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+void hist_record(struct histogram *h, uint64_t value)
+{
+	h->counts[value_to_index(value)]++;
+	h->total++;
+	h->sum += value;
+
+	if (value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+}
+
+uint64_t hist_percentile(const struct histogram *h, double percentile)
+{
+	uint64_t target, count = 0;
+	unsigned int i;
+
+	if (!h->total)
+		return 0;
+
+	target = (uint64_t)(percentile / 100.0 * h->total + 0.5);
+	if (target < 1)
+		target = 1;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		count += h->counts[i];
+		if (count >= target) {
+			uint64_t value = index_to_value(i);
+
+			return value < h->max ? value : h->max;
+		}
+	}
+
+	return h->max;
+}
+
+void hist_print(const struct histogram *h, const char *name, FILE *out)
+{
+	unsigned int i;
+
+	if (!h->total) {
+		fprintf(out, "%s: no samples\n", name);
+		return;
+	}
+
+	fprintf(out, "%s: %" PRIu64 " samples, min %.1f avg %.1f", name,
+		h->total, (double)h->min / NSEC_PER_USEC,
+		(double)h->sum / h->total / NSEC_PER_USEC);
+
+	for (i = 0; i < sizeof(report_percentiles) /
+			sizeof(report_percentiles[0]); i++)
+		fprintf(out, " p%g %.1f", report_percentiles[i],
+			(double)hist_percentile(h, report_percentiles[i]) /
+			NSEC_PER_USEC);
+
+	fprintf(out, " max %.1f usec\n", (double)h->max / NSEC_PER_USEC);
+}
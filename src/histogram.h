@@ -0,0 +1,55 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Log-bucketed histogram: every power of two is split in HIST_SUB_BUCKETS
+ * linear sub-buckets, which bounds the relative error to about 3%.
+ * Values are recorded in nanoseconds and printed in microseconds.
+ */
+#define HIST_SUB_BITS		5
+#define HIST_SUB_BUCKETS	(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS		((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+struct histogram {
+	uint64_t counts[HIST_BUCKETS];
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+};
+
+void hist_init(struct histogram *h);
+
+void hist_record(struct histogram *h, uint64_t value);
+
+uint64_t hist_percentile(const struct histogram *h, double percentile);
+
+void hist_print(const struct histogram *h, const char *name, FILE *out);
+
+#endif /* HISTOGRAM_H */
@@ -0,0 +1,177 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "icount.h"
+#include "timeutil.h"
+
+#define DELTA(from, to, field)	((to)->field - (from)->field)
+
+int icount_interval_ms;
+
+static void icount_print(const char *port, const char *name,
+		const struct serial_counters *from,
+		const struct serial_counters *to)
+{
+	printf("%s: %s: rx %u tx %u frame %u overrun %u parity %u brk %u "
+		"buf_overrun %u\n", port, name, DELTA(from, to, rx),
+		DELTA(from, to, tx), DELTA(from, to, frame),
+		DELTA(from, to, overrun), DELTA(from, to, parity),
+		DELTA(from, to, brk), DELTA(from, to, buf_overrun));
+}
+
+void icount_init(struct icount *ic)
+{
+	ic->fd = -1;
+	ic->name = "";
+	ic->interval_ms = 0;
+	ic->running = 0;
+}
+
+int icount_attach(struct icount *ic, int fd, const char *name,
+		int interval_ms)
+{
+	struct serial_counters counters;
+	int ret;
+
+	ret = serial_get_counters(fd, &counters);
+	if (ret)
+		return ret;
+
+	ic->fd = fd;
+	ic->name = name;
+	ic->interval_ms = icount_interval_ms ? icount_interval_ms : interval_ms;
+
+	return 0;
+}
+
+static void *icount_thread(void *arg)
+{
+	struct icount *ic = (struct icount *)arg;
+	struct serial_counters now;
+	struct timespec deadline;
+	uint64_t next = ic->start_ns;
+	char name[64];
+
+	pthread_mutex_lock(&ic->lock);
+
+	next += ic->interval_ms * NSEC_PER_MSEC;
+	deadline = ns_to_ts(next);
+
+	while (!ic->stop) {
+		if (pthread_cond_timedwait(&ic->cond, &ic->lock,
+				&deadline) != ETIMEDOUT)
+			continue;
+
+		if (!serial_get_counters(ic->fd, &now)) {
+			snprintf(name, sizeof(name), "ICOUNT %7.2f-%7.2f s",
+				(double)(ic->last_ns - ic->start_ns) /
+				NSEC_PER_SEC,
+				(double)(next - ic->start_ns) / NSEC_PER_SEC);
+			icount_print(ic->name, name, &ic->last, &now);
+			ic->last = now;
+			ic->last_ns = next;
+		}
+
+		next += ic->interval_ms * NSEC_PER_MSEC;
+		deadline = ns_to_ts(next);
+	}
+
+	pthread_mutex_unlock(&ic->lock);
+
+	return NULL;
+}
+
+void icount_begin(struct icount *ic)
+{
+	pthread_condattr_t attr;
+
+	if (ic->fd < 0 || serial_get_counters(ic->fd, &ic->start))
+		return;
+
+	ic->last = ic->start;
+	ic->start_ns = now_ns();
+	ic->last_ns = ic->start_ns;
+
+	if (ic->interval_ms <= 0)
+		return;
+
+	ic->stop = 0;
+	pthread_mutex_init(&ic->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&ic->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	ic->running = !pthread_create(&ic->thread, NULL, icount_thread, ic);
+	if (!ic->running) {
+		pthread_cond_destroy(&ic->cond);
+		pthread_mutex_destroy(&ic->lock);
+	}
+}
+
+void icount_end(struct icount *ic, struct results *r)
+{
+	struct serial_counters end;
+
+	if (ic->fd < 0)
+		return;
+
+	if (ic->running) {
+		pthread_mutex_lock(&ic->lock);
+		ic->stop = 1;
+		pthread_cond_signal(&ic->cond);
+		pthread_mutex_unlock(&ic->lock);
+
+		pthread_join(ic->thread, NULL);
+		pthread_cond_destroy(&ic->cond);
+		pthread_mutex_destroy(&ic->lock);
+		ic->running = 0;
+	}
+
+	if (!serial_get_counters(ic->fd, &end)) {
+		icount_print(ic->name, "ICOUNT total", &ic->start, &end);
+
+		results_set_u64(r, "icount_rx", DELTA(&ic->start, &end, rx));
+		results_set_u64(r, "icount_tx", DELTA(&ic->start, &end, tx));
+		results_set_u64(r, "icount_frame",
+			DELTA(&ic->start, &end, frame));
+		results_set_u64(r, "icount_overrun",
+			DELTA(&ic->start, &end, overrun));
+		results_set_u64(r, "icount_parity",
+			DELTA(&ic->start, &end, parity));
+		results_set_u64(r, "icount_brk", DELTA(&ic->start, &end, brk));
+		results_set_u64(r, "icount_buf_overrun",
+			DELTA(&ic->start, &end, buf_overrun));
+	}
+
+	icount_detach(ic);
+}
+
+void icount_detach(struct icount *ic)
+{
+	ic->fd = -1;
+}
@@ -0,0 +1,73 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef ICOUNT_H
+#define ICOUNT_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "results.h"
+#include "serial.h"
+
+/*
+ * Samples the kernel interrupt counters of a port before and after a
+ * command, and optionally on a timer while it runs.
+ */
+struct icount {
+	int fd;			/* the command's port, -1 if unused */
+	const char *name;	/* the port's path, prefixes the reports */
+	int interval_ms;	/* timer sampling period, 0 disables it */
+	int running;
+	int stop;
+	uint64_t start_ns;
+	uint64_t last_ns;
+	struct serial_counters start;
+	struct serial_counters last;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+/* The --icount-interval period, overrides the commands' own if not 0 */
+extern int icount_interval_ms;
+
+void icount_init(struct icount *ic);
+
+/*
+ * Called by a command once its port is open, fd must stay open until
+ * icount_end or icount_detach. Fails if the driver has no counters, in
+ * which case nothing is sampled.
+ */
+int icount_attach(struct icount *ic, int fd, const char *name,
+		int interval_ms);
+
+void icount_begin(struct icount *ic);
+
+/* Reports the deltas since icount_begin and releases the port */
+void icount_end(struct icount *ic, struct results *r);
+
+/* Releases the port without reporting, for commands which never ran */
+void icount_detach(struct icount *ic);
+
+#endif /* ICOUNT_H */
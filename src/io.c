@@ -0,0 +1,124 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+
+#include "io.h"
+
+int write_full(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, p, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+int read_full(int fd, void *buf, size_t len, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	char *p = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = poll(&pfd, 1, timeout_ms);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (ret == 0)
+			return -ETIMEDOUT;
+
+		ret = read(fd, p, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		/* Readable but empty: the other end hung up */
+		if (ret == 0)
+			return -EPIPE;
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+int send_msg(int fd, int type, int arg)
+{
+	int msg[2];
+
+	msg[0] = htonl(type);
+	msg[1] = htonl(arg);
+
+	return write_full(fd, msg, sizeof(msg));
+}
+
+int read_msg(int fd, int *type, int *arg, int timeout_ms)
+{
+	int msg[2];
+	int ret;
+
+	ret = read_full(fd, msg, sizeof(msg), timeout_ms);
+	if (ret)
+		return ret;
+
+	*type = ntohl(msg[0]);
+	*arg = ntohl(msg[1]);
+
+	return 0;
+}
+
+int expect_msg(int fd, int type, int *arg, int timeout_ms)
+{
+	int msg_type, msg_arg, ret;
+
+	ret = read_msg(fd, &msg_type, &msg_arg, timeout_ms);
+	if (ret)
+		return ret;
+
+	if (msg_type != type)
+		return -EPROTO;
+
+	if (arg)
+		*arg = msg_arg;
+
+	return 0;
+}
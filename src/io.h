@@ -0,0 +1,47 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef IO_H
+#define IO_H
+
+#include <stddef.h>
+
+/* Writes all of buf, retrying on short writes. Returns 0 or -errno. */
+int write_full(int fd, const void *buf, size_t len);
+
+/*
+ * Reads exactly len bytes. Fails with -ETIMEDOUT if nothing arrives for
+ * timeout_ms milliseconds; a negative timeout waits forever. Fails with
+ * -EPIPE if the other end hangs up.
+ */
+int read_full(int fd, void *buf, size_t len, int timeout_ms);
+
+/* Control messages: a type and an argument, both in network order */
+int send_msg(int fd, int type, int arg);
+
+int read_msg(int fd, int *type, int *arg, int timeout_ms);
+
+/* Fails with -EPROTO if the next message is not of the given type */
+int expect_msg(int fd, int type, int *arg, int timeout_ms);
+
+#endif /* IO_H */
@@ -23,11 +23,19 @@
  */
 
 #include <errno.h>
+#include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "cmd.h"
 #include "help.h"
+#include "icount.h"
+#include "results.h"
+#include "runner.h"
+#include "trace.h"
+#include "transport.h"
+#include "tty_profile.h"
 
 int cmd_count;
 struct cmd *cmds[MAX_CMDS];
@@ -35,11 +43,102 @@ struct cmd *cmds[MAX_CMDS];
 int main(int argc, char *argv[])
 {
 	int i, found = 0, retval = 0;
+	int c;
 
-	if (argc < 2) {
+	static struct option long_options[] = {
+		{"jobs", required_argument, 0, 'j'},
+		{"cpus", required_argument, 0, 'C'},
+		{"format", required_argument, 0, 'F'},
+		{"icount-interval", required_argument, 0, 'I'},
+		{"loopback", required_argument, 0, 'L'},
+		{"termios", required_argument, 0, 'T'},
+		{"trace", required_argument, 0, 't'},
+		{0, 0, 0, 0}
+	};
+
+	/* Global options stop at the command name */
+	while (1) {
+		int option_index = 0;
+
+		c = getopt_long(argc, argv, "+j:C:F:I:L:T:t:", long_options,
+			&option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'j':
+			runner_opts.jobs = atoi(optarg);
+			break;
+		case 'C':
+			if (parse_cpu_list(optarg, &runner_opts.cpus,
+					&runner_opts.ncpus)) {
+				fprintf(stderr, "Invalid CPU list %s\n", optarg);
+				retval = -EINVAL;
+				goto e_exit;
+			}
+			break;
+		case 'F':
+			if (results_parse_format(optarg)) {
+				fprintf(stderr, "Invalid format %s\n", optarg);
+				retval = -EINVAL;
+				goto e_exit;
+			}
+			break;
+		case 'I':
+			icount_interval_ms = atoi(optarg);
+			if (icount_interval_ms < 0) {
+				fprintf(stderr, "Invalid interval %s\n", optarg);
+				retval = -EINVAL;
+				goto e_exit;
+			}
+			break;
+		case 'L':
+			retval = transport_loopback(optarg);
+			if (retval) {
+				fprintf(stderr, "Unable to set up %s loopback\n",
+					optarg);
+				goto e_exit;
+			}
+			break;
+		case 'T':
+			if (tty_profile_parse(&tty_profile, optarg)) {
+				fprintf(stderr, "Invalid termios profile %s\n",
+					optarg);
+				retval = -EINVAL;
+				goto e_exit;
+			}
+			break;
+		case 't':
+			retval = trace_start(optarg);
+			if (retval) {
+				fprintf(stderr, "Unable to trace to %s\n",
+					optarg);
+				goto e_exit;
+			}
+			break;
+		default:
+			help();
+			retval = -EINVAL;
+			goto e_exit;
+		}
+	}
+
+	if (optind >= argc) {
 		help();
-		return -EINVAL;
+		retval = -EINVAL;
+		goto e_exit;
+	}
+
+	retval = results_setup();
+	if (retval) {
+		fprintf(stderr, "Failed to set up the results output\n");
+		goto e_exit;
 	}
 
-	return run_cmd(argc - 1, &argv[1]);
+	retval = run_cmd(argc - optind, &argv[optind]);
+
+e_exit:
+	/* Also after an option error, a trace started earlier is kept */
+	trace_stop();
+	return retval;
 }
@@ -24,6 +24,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,144 +38,1803 @@
 #include <arpa/inet.h>
 
 #include "cmd.h"
+#include "evloop.h"
+#include "frame.h"
+#include "histogram.h"
+#include "io.h"
+#include "serial.h"
+#include "spsc.h"
+#include "timeutil.h"
+#ifdef HAVE_IO_URING
+#include "uring.h"
+#endif
+
+#define PING_CHUNK_SIZE		256
+#define PING_RX_BUF_SIZE	4096
+#define PING_TX_BUF_SIZE	65536
+#define PING_INTERVAL_MS	1000
+#define PING_START_TIMEOUT_MS	10000
+#define PING_IDLE_TIMEOUT_MS	1000
+#define PING_RTT_TIMEOUT_MS	1000
+#define PING_FRAME_MAGIC	0x50494e47
+#define PING_URING_DEPTH	8
+#define PING_RING_SIZE		(1 << 20)
+#define PING_RING_WAIT_US	50
+
+/* Request flags sent in the upper bits of the command word */
+#define PING_CMD_MASK		0xff
+#define PING_FLAG_FRAMED	0x100
+/* The high 32 bits of the count follow in a COUNT_HI message */
+#define PING_FLAG_COUNT64	0x200
 
 const char ping_help[] = "Usage:\n"
-	"\tuart_test ping [options] <ttyDevice>\n";
+	"\tuart_test ping [options] <ttyDevice>\n"
+	"Options:\n"
+	"\t-s, --server\t\trun as server (peer of the client)\n"
+	"\t-c, --command <cmd>\tSEND, SEND_RECV or PINGPONG\n"
+	"\t-n, --count <n>\t\tsingle burst of <n> bytes, K, M and G "
+	"suffixes\n"
+	"\t\t\t\tallowed (PINGPONG: <n> exchanges)\n"
+	"\t-d, --duration <sec>\tstream for <sec> seconds instead of a burst\n"
+	"\t-k, --chunk <bytes>\twrite size in streaming mode and frame size "
+	"(default 256)\n"
+	"\t-f, --framed\t\tsend sequence-numbered, CRC protected frames\n"
+	"\t-e, --engine <engine>\tthreads (default) or epoll, one loop\n"
+	"\t\t\t\tdrives both directions of a port; the ports of\n"
+	"\t\t\t\ta multi-port run still get one thread each\n"
+	"\t-I, --io <backend>\tI/O of the threads engine: classic (default)\n"
+	"\t\t\t\tor uring, several requests in flight on\n"
+	"\t\t\t\tregistered buffers, unframed data only\n"
+	"\t-r, --rate <rate>\tpace the streaming sender, in bytes/s or "
+	"percent\n\t\t\t\tof the line rate (e.g. 80%)\n"
+	"\t-R, --rate-sweep[=<from>:<to>:<step>]\n"
+	"\t\t\t\tstream --duration seconds at each offered load,\n"
+	"\t\t\t\tin percent of the line rate (default 10:110:10)\n"
+	"\t-K, --chunk-sweep[=<from>:<to>]\n"
+	"\t\t\t\tstream --duration seconds with each write and\n"
+	"\t\t\t\tread size, doubling from <from> to <to> bytes\n"
+	"\t\t\t\t(default 1:65536)\n"
+	"\t-i, --interval <ms>\treport interval in streaming mode "
+	"(default 1000)\n"
+	"\t-b, --ring <bytes>\tring between the receiving thread and the\n"
+	"\t\t\t\tthread verifying the data (default 1048576),\n"
+	"\t\t\t\t0 verifies in the receiving thread\n"
+	"\t-a, --low-latency-ab\trun PINGPONG without, then with\n"
+	"\t\t\t\tASYNC_LOW_LATENCY on both ends and compare the\n"
+	"\t\t\t\tpercentiles\n";
 
 enum {
 	INVALID_REQ,
 	SEND_REQ,
 	SEND_RECV_REQ,
 	OKAY,
-	NOK
+	NOK,
+	STREAM_REQ,
+	STREAM_RECV_REQ,
+	PINGPONG_REQ,
+	SWEEP_REQ,
+	STEP_REQ,
+	REPORT,
+	DONE_REQ,
+	AB_REQ,
+	LOWLAT_REQ,
+	CHUNK_SWEEP_REQ,
+	COUNT_HI
+};
+
+enum {
+	PING_ENGINE_THREADS,
+	PING_ENGINE_EPOLL
+};
+
+enum {
+	PING_IO_CLASSIC,
+	PING_IO_URING
+};
+
+struct ping_frame {
+	uint32_t magic;
+	uint32_t seq;
 };
 
 struct ping_data {
 	int fd;
 	int server;
-	int count;
+	uint64_t count;
 	int cmd;
+	int duration;
+	int chunk;
+	int interval_ms;
+	int framed;
+	int engine;
+	int io;
+	double rate;
+	int rate_pct;
+	int sweep;
+	int sweep_from;
+	int sweep_to;
+	int sweep_step;
+	int chunk_sweep;
+	int chunk_from;
+	int chunk_to;
+	int rx_size;		/* read size of the streaming receiver */
+	int ring_size;		/* receive to verify ring, 0 verifies inline */
+	int ab;
+	struct results *results;
 	pthread_t sender_id;
 	pthread_t receiver_id;
+	struct ping_response *ev_sender;
+	struct ping_response *ev_receiver;
+	struct histogram *rtt;
+	uint64_t lost;
+	uint64_t errors;
+};
+
+struct ping_response {
+	int retval;
+	struct timespec duration;
+	uint64_t bytes;
+	uint64_t errors;
+	struct frame_stats frames;
+	uint64_t cpu_ns;	/* thread CPU time */
+	uint64_t syscalls;	/* I/O system calls */
+	uint64_t reads;		/* reads that returned data */
+	uint64_t ring_size;
+	uint64_t ring_peak;	/* highest fill of the receive ring */
+	uint64_t ring_waits;	/* times the reader found the ring full */
+};
+
+struct token_bucket {
+	double rate;		/* bytes per second */
+	double burst;
+	double tokens;
+	uint64_t last_ns;
+};
+
+/* Per-interval throughput accounting for the streaming mode */
+struct ping_meter {
+	const char *name;
+	int bits;
+	uint64_t interval_ns;
+	uint64_t start_ns;
+	uint64_t last_ns;
+	uint64_t interval_bytes;
+	uint64_t total_bytes;
+};
+
+static void meter_init(struct ping_meter *m, const char *name, int bits,
+		int interval_ms, uint64_t start_ns)
+{
+	memset(m, 0, sizeof(*m));
+	m->name = name;
+	m->bits = bits;
+	m->interval_ns = interval_ms * NSEC_PER_MSEC;
+	m->start_ns = start_ns;
+	m->last_ns = start_ns;
+}
+
+static void meter_report(struct ping_meter *m, uint64_t now)
+{
+	double elapsed = (double)(now - m->last_ns) / NSEC_PER_SEC;
+
+	printf("%s %7.2f-%7.2f s: %10" PRIu64 " bytes %10.0f baud, "
+		"total %" PRIu64 " bytes\n", m->name,
+		(double)(m->last_ns - m->start_ns) / NSEC_PER_SEC,
+		(double)(now - m->start_ns) / NSEC_PER_SEC,
+		m->interval_bytes,
+		elapsed > 0 ? m->interval_bytes * m->bits / elapsed : 0,
+		m->total_bytes);
+
+	m->interval_bytes = 0;
+	m->last_ns = now;
+}
+
+static void meter_update(struct ping_meter *m, size_t bytes)
+{
+	uint64_t now = now_ns();
+
+	m->interval_bytes += bytes;
+	m->total_bytes += bytes;
+
+	if (now - m->last_ns >= m->interval_ns)
+		meter_report(m, now);
+}
+
+static void meter_finish(struct ping_meter *m)
+{
+	uint64_t now = now_ns();
+
+	if (m->interval_bytes)
+		meter_report(m, now);
+}
+
+static void tb_init(struct token_bucket *tb, double rate, double burst)
+{
+	tb->rate = rate;
+	tb->burst = burst;
+	tb->tokens = burst;
+	tb->last_ns = now_ns();
+}
+
+/* Blocks until len bytes may be sent at the configured rate */
+static void tb_consume(struct token_bucket *tb, size_t len)
+{
+	uint64_t now = now_ns(), wait;
+
+	tb->tokens += (double)(now - tb->last_ns) * tb->rate / NSEC_PER_SEC;
+	if (tb->tokens > tb->burst)
+		tb->tokens = tb->burst;
+	tb->last_ns = now;
+
+	if (tb->tokens < len) {
+		wait = (len - tb->tokens) * NSEC_PER_SEC / tb->rate;
+		sleep_until_ns(now + wait);
+		tb->tokens = len;
+		tb->last_ns = now + wait;
+	}
+
+	tb->tokens -= len;
+}
+
+/* Fills buf with frames of pdata->chunk bytes, or with 'a' if not framed */
+static void fill_payload(struct ping_data *pdata, char *buf, size_t len,
+		uint32_t *seq)
+{
+	size_t size;
+
+	if (!pdata->framed) {
+		memset(buf, 'a', len);
+		return;
+	}
+
+	while (len >= FRAME_OVERHEAD) {
+		size = len < (size_t)pdata->chunk ? len : (size_t)pdata->chunk;
+		frame_build(buf, size, (*seq)++);
+		buf += size;
+		len -= size;
+	}
+
+	/* Too short for a frame, the receiver skips it while resyncing */
+	memset(buf, 0, len);
+}
+
+static void verify_payload(struct ping_data *pdata, struct frame_parser *parser,
+		struct ping_response *presp, const char *buf, size_t len)
+{
+	size_t i;
+
+	if (pdata->framed) {
+		frame_parser_feed(parser, buf, len);
+		return;
+	}
+
+	for (i = 0; i < len; i++)
+		if (buf[i] != 'a')
+			presp->errors++;
+}
+
+/*
+ * The receivers only drain the port into a ring, a verifier thread checks
+ * the data behind them so a slow check never leaves bytes in the tty.
+ */
+struct ping_verifier {
+	struct ping_data *pdata;
+	struct ping_response *presp;
+	struct frame_parser *parser;
+	struct spsc_ring ring;
+	char *buf;		/* read buffer when verifying inline */
+	uint64_t cpu_ns;
+	pthread_t id;
+};
+
+static void *verifier_func(void *arg)
+{
+	struct ping_verifier *v = (struct ping_verifier *)arg;
+	uint64_t cpu_ns = thread_cpu_ns();
+	const char *p;
+	size_t len;
+
+	while (1) {
+		len = spsc_read_space(&v->ring, &p);
+		if (!len) {
+			if (spsc_done(&v->ring))
+				break;
+			sleep_until_ns(now_ns() + PING_RING_WAIT_US *
+				NSEC_PER_USEC);
+			continue;
+		}
+
+		verify_payload(v->pdata, v->parser, v->presp, p, len);
+		spsc_release(&v->ring, len);
+	}
+
+	v->cpu_ns = thread_cpu_ns() - cpu_ns;
+	return NULL;
+}
+
+static int verifier_start(struct ping_verifier *v, struct ping_data *pdata,
+		struct ping_response *presp, struct frame_parser *parser)
+{
+	int ret;
+
+	memset(v, 0, sizeof(*v));
+	v->pdata = pdata;
+	v->presp = presp;
+	v->parser = parser;
+
+	if (!pdata->ring_size) {
+		v->buf = (char *)malloc(pdata->rx_size);
+		return v->buf ? 0 : -ENOMEM;
+	}
+
+	ret = spsc_init(&v->ring, pdata->ring_size);
+	if (ret)
+		return ret;
+
+	ret = -pthread_create(&v->id, NULL, verifier_func, v);
+	if (ret)
+		spsc_free(&v->ring);
+
+	return ret;
+}
+
+static void verifier_stop(struct ping_verifier *v)
+{
+	if (!v->ring.buf) {
+		free(v->buf);
+		return;
+	}
+
+	spsc_close(&v->ring);
+	pthread_join(v->id, NULL);
+
+	v->presp->cpu_ns += v->cpu_ns;
+	v->presp->ring_size = v->ring.size;
+	v->presp->ring_peak = v->ring.peak;
+	spsc_free(&v->ring);
+}
+
+/* Same contract as read(2), at most max bytes go to the verifier */
+static ssize_t verifier_read(struct ping_verifier *v, size_t max)
+{
+	ssize_t ret;
+	size_t len;
+	char *p;
+
+	if (!v->ring.buf) {
+		if (max > (size_t)v->pdata->rx_size)
+			max = v->pdata->rx_size;
+
+		ret = read(v->pdata->fd, v->buf, max);
+		if (ret > 0)
+			verify_payload(v->pdata, v->parser, v->presp, v->buf,
+				ret);
+		return ret;
+	}
+
+	while (!(len = spsc_write_space(&v->ring, &p))) {
+		v->presp->ring_waits++;
+		sleep_until_ns(now_ns() + PING_RING_WAIT_US * NSEC_PER_USEC);
+	}
+
+	ret = read(v->pdata->fd, p, len < max ? len : max);
+	if (ret > 0)
+		spsc_commit(&v->ring, ret);
+
+	return ret;
+}
+
+/*
+ * Sends the burst through one reusable buffer, whatever the count. Framed
+ * payloads are generated as they go, in whole frames except at the end.
+ */
+static void *sender_func(void *arg)
+{
+	struct ping_data *pdata = (struct ping_data *)arg;
+	struct ping_response *presp = NULL;
+	char *buf;
+	struct timespec start, stop;
+	size_t size, len, off;
+	ssize_t retval;
+	uint32_t seq = 0;
+
+	if (!pdata)
+		return NULL;
+
+	presp = (struct ping_response *)calloc(1, sizeof(struct ping_response));
+	if (!presp)
+		return NULL;
+
+	size = PING_TX_BUF_SIZE;
+	if (pdata->framed)
+		size = size < (size_t)pdata->chunk ? (size_t)pdata->chunk :
+			size / pdata->chunk * pdata->chunk;
+	if (size > pdata->count)
+		size = pdata->count;
+
+	buf = malloc(size);
+	if (!buf) {
+		presp->retval = -ENOMEM;
+		return presp;
+	}
+
+	if (!pdata->framed)
+		fill_payload(pdata, buf, size, &seq);
+
+	presp->cpu_ns = thread_cpu_ns();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (presp->bytes < pdata->count && !presp->retval) {
+		len = size;
+		if (len > pdata->count - presp->bytes)
+			len = pdata->count - presp->bytes;
+		if (pdata->framed)
+			fill_payload(pdata, buf, len, &seq);
+
+		for (off = 0; off < len; off += retval) {
+			retval = write(pdata->fd, buf + off, len - off);
+			presp->syscalls++;
+			if (retval < 0) {
+				retval = 0;
+				if (errno == EINTR)
+					continue;
+				presp->retval = -errno;
+				break;
+			}
+			presp->bytes += retval;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	presp->cpu_ns = thread_cpu_ns() - presp->cpu_ns;
+	presp->frames.frames = seq;
+
+	presp->duration.tv_sec = stop.tv_sec - start.tv_sec;
+	presp->duration.tv_nsec = stop.tv_nsec - start.tv_nsec;
+
+	free(buf);
+	printf("Sender DONE.\n");
+	return presp;
+}
+
+static void *receiver_func(void *arg)
+{
+	struct ping_data *pdata = (struct ping_data *)arg;
+	struct ping_response *presp = NULL;
+	struct ping_verifier verifier;
+	struct frame_parser *parser = NULL;
+	struct timespec start, stop;
+	ssize_t read_bytes;
+	uint64_t read_count;
+	int ret;
+
+	if (!pdata)
+		return NULL;
+
+	presp = (struct ping_response *)calloc(1, sizeof(struct ping_response));
+	if (!presp)
+		return NULL;
+
+	if (pdata->framed) {
+		parser = (struct frame_parser *)malloc(sizeof(*parser));
+		if (!parser) {
+			presp->retval = -ENOMEM;
+			return presp;
+		}
+		frame_parser_init(parser);
+	}
+
+	ret = verifier_start(&verifier, pdata, presp, parser);
+	if (ret) {
+		free(parser);
+		presp->retval = ret;
+		return presp;
+	}
+
+	presp->cpu_ns = thread_cpu_ns();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	read_count = 0;
+	do {
+		read_bytes = verifier_read(&verifier,
+				pdata->count - read_count);
+		presp->syscalls++;
+		if (read_bytes < 0) {
+			/* read error */
+			presp->retval = -errno;
+			break;
+		}
+		if (read_bytes == 0) {
+			/* Hangup, the next read would return 0 right away */
+			presp->retval = -EPIPE;
+			break;
+		}
+		presp->reads++;
+		read_count += read_bytes;
+	} while (read_count < pdata->count);
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	presp->cpu_ns = thread_cpu_ns() - presp->cpu_ns;
+
+	verifier_stop(&verifier);
+	if (parser) {
+		presp->frames = parser->stats;
+		free(parser);
+	}
+
+	if (presp->retval)
+		return presp;
+
+	if (presp->errors || presp->frames.lost || presp->frames.corrupted ||
+			presp->frames.out_of_order) {
+		presp->retval = -EINVAL;
+		return presp;
+	}
+
+	presp->bytes = read_count;
+	presp->duration.tv_sec = stop.tv_sec - start.tv_sec;
+	presp->duration.tv_nsec = stop.tv_nsec - start.tv_nsec;
+
+	printf("Receiver DONE.\n");
+
+	return presp;
+}
+
+static void *stream_sender_func(void *arg)
+{
+	struct ping_data *pdata = (struct ping_data *)arg;
+	struct ping_response *presp = NULL;
+	struct ping_meter meter;
+	struct token_bucket tb;
+	uint64_t start, deadline;
+	char *buf;
+	ssize_t retval;
+	uint32_t seq = 0;
+
+	if (!pdata)
+		return NULL;
+
+	presp = (struct ping_response *)calloc(1, sizeof(struct ping_response));
+	if (!presp)
+		return NULL;
+
+	buf = malloc(pdata->chunk);
+	if (!buf) {
+		presp->retval = -ENOMEM;
+		return presp;
+	}
+
+	memset(buf, 'a', pdata->chunk);
+
+	presp->cpu_ns = thread_cpu_ns();
+	start = now_ns();
+	deadline = start + pdata->duration * NSEC_PER_SEC;
+	meter_init(&meter, "TX", serial_bits_per_char(pdata->fd),
+		pdata->interval_ms, start);
+	if (pdata->rate > 0)
+		tb_init(&tb, pdata->rate, pdata->chunk);
+
+	while (now_ns() < deadline) {
+		if (pdata->rate > 0)
+			tb_consume(&tb, pdata->chunk);
+
+		if (pdata->framed) {
+			/* Frames must not be split by a short write */
+			fill_payload(pdata, buf, pdata->chunk, &seq);
+			retval = write_full(pdata->fd, buf, pdata->chunk);
+			presp->syscalls++;
+			if (retval) {
+				presp->retval = retval;
+				break;
+			}
+			meter_update(&meter, pdata->chunk);
+			continue;
+		}
+
+		retval = write(pdata->fd, buf, pdata->chunk);
+		presp->syscalls++;
+		if (retval < 0) {
+			if (errno == EINTR)
+				continue;
+			presp->retval = -errno;
+			break;
+		}
+		meter_update(&meter, retval);
+	}
+
+	/* Include the time needed to drain the kernel buffer */
+	tcdrain(pdata->fd);
+	meter_finish(&meter);
+	presp->cpu_ns = thread_cpu_ns() - presp->cpu_ns;
+
+	presp->duration = ns_to_ts(now_ns() - start);
+	presp->bytes = meter.total_bytes;
+	presp->frames.frames = seq;
+
+	free(buf);
+	printf("Sender DONE.\n");
+	return presp;
+}
+
+static void *stream_receiver_func(void *arg)
+{
+	struct ping_data *pdata = (struct ping_data *)arg;
+	struct ping_response *presp = NULL;
+	struct ping_meter meter;
+	struct frame_parser *parser = NULL;
+	struct pollfd pfd;
+	struct ping_verifier verifier;
+	uint64_t start = 0, last = 0, duration_ns;
+	ssize_t read_bytes;
+	int retval;
+
+	if (!pdata)
+		return NULL;
+
+	presp = (struct ping_response *)calloc(1, sizeof(struct ping_response));
+	if (!presp)
+		return NULL;
+
+	if (pdata->framed) {
+		parser = (struct frame_parser *)malloc(sizeof(*parser));
+		if (!parser) {
+			presp->retval = -ENOMEM;
+			return presp;
+		}
+		frame_parser_init(parser);
+	}
+
+	retval = verifier_start(&verifier, pdata, presp, parser);
+	if (retval) {
+		free(parser);
+		presp->retval = retval;
+		return presp;
+	}
+
+	duration_ns = pdata->duration * NSEC_PER_SEC;
+	pfd.fd = pdata->fd;
+	pfd.events = POLLIN;
+	presp->cpu_ns = thread_cpu_ns();
+
+	while (1) {
+		retval = poll(&pfd, 1, start ? PING_IDLE_TIMEOUT_MS :
+				PING_START_TIMEOUT_MS);
+		presp->syscalls++;
+		if (retval < 0) {
+			if (errno == EINTR)
+				continue;
+			presp->retval = -errno;
+			break;
+		}
+
+		if (retval == 0) {
+			if (!start) {
+				presp->retval = -ETIMEDOUT;
+				break;
+			}
+			meter_update(&meter, 0);
+			/* The stream is over once the line goes idle */
+			if (now_ns() - start >= duration_ns)
+				break;
+			continue;
+		}
+
+		read_bytes = verifier_read(&verifier, pdata->rx_size);
+		presp->syscalls++;
+		if (read_bytes < 0) {
+			if (errno == EINTR)
+				continue;
+			presp->retval = -errno;
+			break;
+		}
+		presp->reads++;
+
+		/* Measure from the first received byte */
+		if (!start) {
+			start = now_ns();
+			meter_init(&meter, "RX", serial_bits_per_char(pdata->fd),
+				pdata->interval_ms, start);
+		}
+
+		meter_update(&meter, read_bytes);
+		last = now_ns();
+	}
+
+	presp->cpu_ns = thread_cpu_ns() - presp->cpu_ns;
+	verifier_stop(&verifier);
+
+	if (start) {
+		meter_finish(&meter);
+		presp->duration = ns_to_ts(last - start);
+		presp->bytes = meter.total_bytes;
+	}
+
+	if (parser) {
+		presp->frames = parser->stats;
+		free(parser);
+	}
+
+	printf("Receiver DONE.\n");
+	return presp;
+}
+
+#ifdef HAVE_IO_URING
+/*
+ * Keeps up to PING_URING_DEPTH writes of registered buffers in flight. Each
+ * batch is linked so the writes reach the port in order; a short write
+ * cancels the rest of the chain, which is resubmitted with the next batch.
+ */
+static void *uring_sender_func(void *arg)
+{
+	struct ping_data *pdata = (struct ping_data *)arg;
+	struct ping_response *presp = NULL;
+	struct ping_meter meter;
+	struct uring ring;
+	struct iovec iov[PING_URING_DEPTH];
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	size_t len[PING_URING_DEPTH], done[PING_URING_DEPTH];
+	int order[PING_URING_DEPTH], busy[PING_URING_DEPTH] = { 0 };
+	uint64_t start, deadline, left;
+	uint32_t seq = 0;
+	char *bufs;
+	int i, n, idx, kept, res, ret;
+
+	if (!pdata)
+		return NULL;
+
+	presp = (struct ping_response *)calloc(1, sizeof(struct ping_response));
+	if (!presp)
+		return NULL;
+
+	bufs = malloc(PING_URING_DEPTH * pdata->chunk);
+	if (!bufs) {
+		presp->retval = -ENOMEM;
+		return presp;
+	}
+
+	ret = uring_init(&ring, PING_URING_DEPTH);
+	if (ret) {
+		presp->retval = ret;
+		goto e_free;
+	}
+
+	for (i = 0; i < PING_URING_DEPTH; i++) {
+		iov[i].iov_base = bufs + i * pdata->chunk;
+		iov[i].iov_len = pdata->chunk;
+	}
+	memset(bufs, 'a', PING_URING_DEPTH * pdata->chunk);
+
+	ret = uring_register_buffers(&ring, iov, PING_URING_DEPTH);
+	if (ret) {
+		presp->retval = ret;
+		goto e_destroy;
+	}
+
+	presp->cpu_ns = thread_cpu_ns();
+	start = now_ns();
+	deadline = start + pdata->duration * NSEC_PER_SEC;
+	left = pdata->count;
+	meter_init(&meter, "TX", serial_bits_per_char(pdata->fd),
+		pdata->interval_ms, start);
+
+	n = 0;
+	while (!presp->retval) {
+		/* Top up the batch behind the writes carried over */
+		for (idx = 0; idx < PING_URING_DEPTH && n < PING_URING_DEPTH;
+				idx++) {
+			if (busy[idx])
+				continue;
+			if (pdata->duration ? now_ns() >= deadline : !left)
+				break;
+
+			len[idx] = pdata->chunk;
+			if (!pdata->duration && left < len[idx])
+				len[idx] = left;
+			left -= pdata->duration ? 0 : len[idx];
+
+			if (pdata->framed)
+				fill_payload(pdata, iov[idx].iov_base, len[idx],
+					&seq);
+			done[idx] = 0;
+			busy[idx] = 1;
+			order[n++] = idx;
+		}
+
+		if (!n)
+			break;
+
+		for (i = 0; i < n; i++) {
+			idx = order[i];
+			sqe = uring_get_sqe(&ring);
+			uring_prep_rw(sqe, IORING_OP_WRITE_FIXED, pdata->fd,
+				(char *)iov[idx].iov_base + done[idx],
+				len[idx] - done[idx], idx, idx);
+			if (i < n - 1)
+				sqe->flags |= IOSQE_IO_LINK;
+		}
+
+		ret = uring_submit(&ring, n, -1);
+		if (ret < 0) {
+			presp->retval = ret;
+			break;
+		}
+
+		/* Completions of a chain are posted in submission order */
+		for (i = 0; i < n; i++) {
+			while (!(cqe = uring_peek_cqe(&ring))) {
+				ret = uring_submit(&ring, 1, -1);
+				if (ret < 0) {
+					presp->retval = ret;
+					goto e_unregister;
+				}
+			}
+			idx = (int)cqe->user_data;
+			res = cqe->res;
+			uring_cqe_seen(&ring);
+
+			if (res > 0) {
+				done[idx] += res;
+				meter_update(&meter, res);
+			} else if (res < 0 && res != -ECANCELED &&
+					res != -EINTR && res != -EAGAIN) {
+				presp->retval = res;
+			}
+		}
+
+		kept = 0;
+		for (i = 0; i < n; i++) {
+			idx = order[i];
+			if (done[idx] < len[idx])
+				order[kept++] = idx;
+			else
+				busy[idx] = 0;
+		}
+		n = kept;
+	}
+
+e_unregister:
+	/* Include the time needed to drain the kernel buffer */
+	tcdrain(pdata->fd);
+	if (pdata->duration)
+		meter_finish(&meter);
+	presp->cpu_ns = thread_cpu_ns() - presp->cpu_ns;
+	presp->syscalls = ring.enters;
+
+	presp->duration = ns_to_ts(now_ns() - start);
+	presp->bytes = meter.total_bytes;
+	presp->frames.frames = seq;
+
+e_destroy:
+	uring_destroy(&ring);
+e_free:
+	free(bufs);
+	printf("Sender DONE.\n");
+	return presp;
+}
+
+static int uring_queue_read(struct uring *ring, int fd, char *bufs, int idx)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(ring);
+
+	if (!sqe)
+		return -EBUSY;
+
+	uring_prep_rw(sqe, IORING_OP_READ_FIXED, fd,
+		bufs + idx * PING_RX_BUF_SIZE, PING_RX_BUF_SIZE, idx, idx);
+	return 0;
+}
+
+/*
+ * Keeps PING_URING_DEPTH reads of registered buffers in flight and consumes
+ * them in completion order.
+ */
+static void *uring_receiver_func(void *arg)
+{
+	struct ping_data *pdata = (struct ping_data *)arg;
+	struct ping_response *presp = NULL;
+	struct ping_meter meter;
+	struct frame_parser *parser = NULL;
+	struct uring ring;
+	struct iovec iov[PING_URING_DEPTH];
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	uint64_t start = 0, last = 0, duration_ns, cpu;
+	int i, idx, res, ret, inflight = 0;
+	char *bufs;
+
+	if (!pdata)
+		return NULL;
+
+	presp = (struct ping_response *)calloc(1, sizeof(struct ping_response));
+	if (!presp)
+		return NULL;
+
+	bufs = malloc(PING_URING_DEPTH * PING_RX_BUF_SIZE);
+	if (!bufs) {
+		presp->retval = -ENOMEM;
+		return presp;
+	}
+
+	if (pdata->framed) {
+		parser = (struct frame_parser *)malloc(sizeof(*parser));
+		if (!parser) {
+			presp->retval = -ENOMEM;
+			goto e_free;
+		}
+		frame_parser_init(parser);
+	}
+
+	/* One spare entry for the final cancellation */
+	ret = uring_init(&ring, PING_URING_DEPTH + 1);
+	if (ret) {
+		presp->retval = ret;
+		goto e_free;
+	}
+
+	for (i = 0; i < PING_URING_DEPTH; i++) {
+		iov[i].iov_base = bufs + i * PING_RX_BUF_SIZE;
+		iov[i].iov_len = PING_RX_BUF_SIZE;
+	}
+
+	ret = uring_register_buffers(&ring, iov, PING_URING_DEPTH);
+	if (ret) {
+		presp->retval = ret;
+		goto e_destroy;
+	}
+
+	duration_ns = pdata->duration * NSEC_PER_SEC;
+	cpu = thread_cpu_ns();
+
+	for (i = 0; i < PING_URING_DEPTH; i++, inflight++)
+		uring_queue_read(&ring, pdata->fd, bufs, i);
+
+	while (1) {
+		ret = uring_submit(&ring, 1, start ? PING_IDLE_TIMEOUT_MS :
+				PING_START_TIMEOUT_MS);
+		if (ret < 0) {
+			presp->retval = ret;
+			break;
+		}
+
+		cqe = uring_peek_cqe(&ring);
+		if (!cqe) {
+			if (!start) {
+				presp->retval = -ETIMEDOUT;
+				break;
+			}
+			meter_update(&meter, 0);
+			/* The stream is over once the line goes idle */
+			if (!pdata->duration || now_ns() - start >= duration_ns)
+				break;
+			continue;
+		}
+
+		idx = (int)cqe->user_data;
+		res = cqe->res;
+		uring_cqe_seen(&ring);
+		inflight--;
+
+		if (res < 0 && res != -EINTR && res != -EAGAIN) {
+			presp->retval = res;
+			break;
+		}
+
+		/* Hangup, the read would complete with 0 again right away */
+		if (res == 0) {
+			if (!pdata->duration)
+				presp->retval = -EPIPE;
+			break;
+		}
+
+		if (res > 0) {
+			presp->reads++;
+			/* Measure from the first received byte */
+			if (!start) {
+				start = now_ns();
+				meter_init(&meter, "RX",
+					serial_bits_per_char(pdata->fd),
+					pdata->interval_ms, start);
+			}
+
+			verify_payload(pdata, parser, presp,
+				bufs + idx * PING_RX_BUF_SIZE, res);
+			meter_update(&meter, res);
+			last = now_ns();
+		}
+
+		if (!pdata->duration && start &&
+				meter.total_bytes >= (uint64_t)pdata->count)
+			break;
+
+		uring_queue_read(&ring, pdata->fd, bufs, idx);
+		inflight++;
+	}
+
+	/* The buffers must not be released under pending reads */
+	if (inflight && (sqe = uring_get_sqe(&ring))) {
+		uring_prep_cancel_all(sqe, PING_URING_DEPTH);
+		inflight++;
+	}
+	while (inflight > 0) {
+		if (uring_submit(&ring, 1, PING_IDLE_TIMEOUT_MS) < 0)
+			break;
+		cqe = uring_peek_cqe(&ring);
+		if (!cqe)
+			break;
+		uring_cqe_seen(&ring);
+		inflight--;
+	}
+
+	presp->cpu_ns = thread_cpu_ns() - cpu;
+	presp->syscalls = ring.enters;
+
+	if (start) {
+		if (pdata->duration)
+			meter_finish(&meter);
+		presp->duration = ns_to_ts(last - start);
+		presp->bytes = meter.total_bytes;
+	}
+
+	if (parser)
+		presp->frames = parser->stats;
+
+	if (!presp->retval && (presp->errors || presp->frames.lost ||
+			presp->frames.corrupted || presp->frames.out_of_order))
+		presp->retval = -EINVAL;
+
+e_destroy:
+	uring_destroy(&ring);
+e_free:
+	free(parser);
+	free(bufs);
+	printf("Receiver DONE.\n");
+	return presp;
+}
+#endif
+
+static int start_sender(struct ping_data *pdata, pthread_attr_t *attr)
+{
+#ifdef HAVE_IO_URING
+	if (pdata->io == PING_IO_URING)
+		return pthread_create(&pdata->sender_id, attr,
+			&uring_sender_func, (void *)pdata);
+#endif
+	return pthread_create(&pdata->sender_id, attr,
+		pdata->duration ? &stream_sender_func : &sender_func,
+		(void *)pdata);
+}
+
+static int start_receiver(struct ping_data *pdata, pthread_attr_t *attr)
+{
+#ifdef HAVE_IO_URING
+	if (pdata->io == PING_IO_URING)
+		return pthread_create(&pdata->receiver_id, attr,
+			&uring_receiver_func, (void *)pdata);
+#endif
+	return pthread_create(&pdata->receiver_id, attr,
+		pdata->duration ? &stream_receiver_func : &receiver_func,
+		(void *)pdata);
+}
+
+/* State shared by the epoll engine callbacks */
+struct ping_ev {
+	struct ping_data *pdata;
+	struct ping_meter tx_meter;
+	struct ping_meter rx_meter;
+	struct frame_parser *parser;
+	uint64_t tx_start;
+	uint64_t tx_deadline;
+	uint64_t tx_produced;
+	uint64_t tx_reported;
+	uint64_t rx_start;
+	uint64_t rx_last;
+	uint32_t seq;
 };
 
-struct ping_response {
-	int retval;
-	struct timespec duration;
-};
+static ssize_t ping_ev_fill(struct ev_port *port, char *buf, size_t len)
+{
+	struct ping_ev *ev = (struct ping_ev *)port->priv;
+	struct ping_data *pdata = ev->pdata;
+	size_t size = len;
+
+	meter_update(&ev->tx_meter, port->tx_bytes - ev->tx_reported);
+	ev->tx_reported = port->tx_bytes;
+
+	if (pdata->duration) {
+		if (now_ns() >= ev->tx_deadline)
+			return 0;
+	} else {
+		if (ev->tx_produced >= (uint64_t)pdata->count)
+			return 0;
+		if (size > pdata->count - ev->tx_produced)
+			size = pdata->count - ev->tx_produced;
+	}
+
+	fill_payload(pdata, buf, size, &ev->seq);
+	ev->tx_produced += size;
+
+	return size;
+}
+
+static int ping_ev_consume(struct ev_port *port, const char *buf, size_t len)
+{
+	struct ping_ev *ev = (struct ping_ev *)port->priv;
+	struct ping_data *pdata = ev->pdata;
+
+	if (!ev->rx_start) {
+		ev->rx_start = now_ns();
+		meter_init(&ev->rx_meter, "RX", serial_bits_per_char(pdata->fd),
+			pdata->interval_ms, ev->rx_start);
+		port->rx_timeout_ms = PING_IDLE_TIMEOUT_MS;
+	}
+
+	verify_payload(pdata, ev->parser, pdata->ev_receiver, buf, len);
+	meter_update(&ev->rx_meter, len);
+	ev->rx_last = port->rx_last_ns;
+
+	if (!pdata->duration && port->rx_bytes >= (uint64_t)pdata->count)
+		return 1;
+
+	return 0;
+}
+
+static int ping_ev_timeout(struct ev_port *port)
+{
+	struct ping_ev *ev = (struct ping_ev *)port->priv;
+	struct ping_data *pdata = ev->pdata;
+
+	if (!ev->rx_start || !pdata->duration)
+		return -ETIMEDOUT;
+
+	meter_update(&ev->rx_meter, 0);
+
+	/* The stream is over once the line goes idle */
+	return now_ns() - ev->rx_start >= pdata->duration * NSEC_PER_SEC;
+}
+
+static const struct ev_ops ping_ev_ops = {
+	.fill = ping_ev_fill,
+	.consume = ping_ev_consume,
+	.timeout = ping_ev_timeout,
+};
+
+/*
+ * Drives both directions from the calling thread with non-blocking I/O.
+ * The loop holds this port only: the runner still gives every port of a
+ * multi-port run its own thread, sharing one loop between them is not
+ * done yet.
+ */
+static int ping_run_evloop(struct ping_data *pdata, int tx, int rx)
+{
+	struct ping_ev ev;
+	struct ev_port port;
+	struct evloop loop;
+	int ret;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.pdata = pdata;
+
+	if (tx) {
+		pdata->ev_sender = (struct ping_response *)calloc(1,
+			sizeof(struct ping_response));
+		if (!pdata->ev_sender)
+			return -ENOMEM;
+	}
+
+	if (rx) {
+		pdata->ev_receiver = (struct ping_response *)calloc(1,
+			sizeof(struct ping_response));
+		if (!pdata->ev_receiver)
+			return -ENOMEM;
+
+		if (pdata->framed) {
+			ev.parser = (struct frame_parser *)
+				malloc(sizeof(*ev.parser));
+			if (!ev.parser)
+				return -ENOMEM;
+			frame_parser_init(ev.parser);
+		}
+	}
+
+	ret = ev_port_init(&port, pdata->fd, &ping_ev_ops,
+		tx ? pdata->chunk : 0, rx ? PING_RX_BUF_SIZE : 0, &ev);
+	if (ret)
+		goto e_free_parser;
+
+	port.rx_timeout_ms = PING_START_TIMEOUT_MS;
+
+	ret = evloop_init(&loop);
+	if (ret)
+		goto e_destroy_port;
+
+	ev.tx_start = now_ns();
+	ev.tx_deadline = ev.tx_start + pdata->duration * NSEC_PER_SEC;
+	meter_init(&ev.tx_meter, "TX", serial_bits_per_char(pdata->fd),
+		pdata->interval_ms, ev.tx_start);
+
+	ret = evloop_add(&loop, &port);
+	if (!ret)
+		ret = evloop_run(&loop);
+
+	if (tx) {
+		struct ping_response *presp = pdata->ev_sender;
+
+		/* Include the time needed to drain the kernel buffer */
+		tcdrain(pdata->fd);
+		meter_update(&ev.tx_meter, port.tx_bytes - ev.tx_reported);
+		meter_finish(&ev.tx_meter);
+		presp->retval = port.error;
+		presp->bytes = port.tx_bytes;
+		presp->frames.frames = ev.seq;
+		presp->duration = ns_to_ts(now_ns() - ev.tx_start);
+	}
+
+	if (rx) {
+		struct ping_response *presp = pdata->ev_receiver;
+
+		presp->retval = port.error;
+		if (ev.rx_start) {
+			meter_finish(&ev.rx_meter);
+			presp->bytes = port.rx_bytes;
+			presp->duration = ns_to_ts(ev.rx_last - ev.rx_start);
+		}
+		if (ev.parser)
+			presp->frames = ev.parser->stats;
+
+		if (!pdata->duration && !presp->retval && (presp->errors ||
+				presp->frames.lost || presp->frames.corrupted ||
+				presp->frames.out_of_order))
+			presp->retval = -EINVAL;
+	}
+
+	printf("Engine: %" PRIu64 " wakeups, %" PRIu64 " reads, %" PRIu64
+		" partial writes, %" PRIu64 " EAGAIN\n", loop.wakeups,
+		port.rx_reads, port.tx_partial, port.tx_eagain);
+
+	evloop_destroy(&loop);
+e_destroy_port:
+	ev_port_destroy(&port);
+e_free_parser:
+	free(ev.parser);
+	return ret;
+}
 
-static int send_cmd(int fd, int cmd, int arg)
-{
-	int netcmd, netarg;
+/* Every value travels as two REPORT messages, high half first */
+#define PING_REPORT_VALUES	11
 
-	netcmd = htonl(cmd);
-	netarg = htonl(arg);
+static int send_report(int fd, struct ping_response *resp)
+{
+	uint64_t values[PING_REPORT_VALUES] = {
+		(uint64_t)(int64_t)resp->retval,
+		resp->bytes,
+		ts_to_ns(&resp->duration),
+		resp->frames.frames,
+		resp->frames.lost,
+		resp->frames.corrupted,
+		resp->frames.out_of_order,
+		resp->errors,
+		resp->reads,
+		resp->syscalls,
+		resp->cpu_ns,
+	};
+	unsigned int i;
+	int ret;
 
-	/* TODO: Add err checking */
-	write(fd, (const void *)&netcmd, sizeof(int));
-	write(fd, (const void *)&netarg, sizeof(int));
+	for (i = 0; i < PING_REPORT_VALUES; i++) {
+		ret = send_msg(fd, REPORT, values[i] >> 32);
+		if (!ret)
+			ret = send_msg(fd, REPORT, (uint32_t)values[i]);
+		if (ret)
+			return ret;
+	}
 
 	return 0;
 }
 
-static int read_cmd(int fd, int *cmd, int *arg)
+static int read_report(int fd, struct ping_response *resp)
 {
-	int netcmd, netarg;
+	uint64_t values[PING_REPORT_VALUES];
+	int command, hi, lo;
+	unsigned int i;
+	int ret;
 
-	read(fd, (void *)&netcmd, sizeof(int));
-	read(fd, (void *)&netarg, sizeof(int));
+	for (i = 0; i < PING_REPORT_VALUES; i++) {
+		ret = read_msg(fd, &command, &hi, -1);
+		if (!ret && command == REPORT)
+			ret = read_msg(fd, &command, &lo, -1);
+		if (ret)
+			return ret;
+		if (command != REPORT)
+			return -EPROTO;
+		values[i] = (uint64_t)(uint32_t)hi << 32 | (uint32_t)lo;
+	}
 
-	*cmd = ntohl(netcmd);
-	*arg = ntohl(netarg);
+	memset(resp, 0, sizeof(*resp));
+	resp->retval = (int)values[0];
+	resp->bytes = values[1];
+	resp->duration = ns_to_ts(values[2]);
+	resp->frames.frames = values[3];
+	resp->frames.lost = values[4];
+	resp->frames.corrupted = values[5];
+	resp->frames.out_of_order = values[6];
+	resp->errors = values[7];
+	resp->reads = values[8];
+	resp->syscalls = values[9];
+	resp->cpu_ns = values[10];
 
 	return 0;
 }
 
-/* TODO: Implement proper return value */
-static void *sender_func(void *arg)
+static double resp_rate(struct ping_response *resp)
 {
-	struct ping_data *pdata = (struct ping_data *)arg;
-	struct ping_response *presp = NULL;
-	char *buf;
-	struct timespec start, stop;
-	ssize_t retval;
+	uint64_t duration = ts_to_ns(&resp->duration);
 
-	if (!pdata)
-		return NULL;
+	return duration ? (double)resp->bytes * NSEC_PER_SEC / duration : 0;
+}
 
-	presp = (struct ping_response *)calloc(1, sizeof(struct ping_response));
-	if (!presp)
-		return NULL;
+/*
+ * Streams --duration seconds at each offered load step. The server reports
+ * what it received after every step.
+ */
+static int rate_sweep_client(struct ping_data *pdata)
+{
+	struct ping_response *sent, received;
+	double line_rate;
+	int64_t lost;
+	int command, arg, pct;
+	int ret;
 
-	buf = malloc(pdata->count);
-	if (!buf) {
-		presp->retval = -ENOMEM;
-		return presp;
+	line_rate = serial_line_rate(pdata->fd);
+	if (line_rate <= 0)
+		return -EINVAL;
+
+	ret = send_msg(pdata->fd, SWEEP_REQ | PING_FLAG_FRAMED,
+		pdata->duration);
+	if (!ret)
+		ret = read_msg(pdata->fd, &command, &arg, -1);
+	if (ret)
+		return ret;
+	if (command != OKAY)
+		return -EPROTO;
+
+	printf("%8s %12s %12s %12s %10s %10s %8s %8s %7s\n", "Offered",
+		"Offered B/s", "Sent B/s", "Recv B/s", "Frames", "Received",
+		"Lost", "Corrupt", "Loss");
+
+	for (pct = pdata->sweep_from; pct <= pdata->sweep_to;
+			pct += pdata->sweep_step) {
+		pdata->rate = line_rate * pct / 100;
+
+		ret = send_msg(pdata->fd, STEP_REQ, pct);
+		if (!ret)
+			ret = read_msg(pdata->fd, &command, &arg, -1);
+		if (ret)
+			return ret;
+		if (command != OKAY)
+			return -EPROTO;
+
+		sent = (struct ping_response *)stream_sender_func(pdata);
+		if (!sent)
+			return -ENOMEM;
+
+		ret = sent->retval;
+		if (!ret)
+			ret = read_report(pdata->fd, &received);
+		if (ret) {
+			free(sent);
+			return ret;
+		}
+
+		lost = sent->frames.frames - received.frames.frames;
+		if (lost < 0)
+			lost = 0;
+
+		printf("%7d%% %12.0f %12.0f %12.0f %10" PRIu64 " %10" PRIu64
+			" %8" PRId64 " %8" PRIu64 " %6.2f%%\n", pct,
+			pdata->rate, resp_rate(sent), resp_rate(&received),
+			sent->frames.frames, received.frames.frames, lost,
+			received.frames.corrupted, sent->frames.frames ?
+			100.0 * lost / sent->frames.frames : 0);
+
+		results_add_u64(pdata->results, "steps", 1);
+		results_add_u64(pdata->results, "tx_bytes", sent->bytes);
+		results_add_u64(pdata->results, "rx_bytes", received.bytes);
+		results_add_u64(pdata->results, "errors", lost +
+			received.frames.corrupted + received.frames.out_of_order);
+		free(sent);
 	}
 
-	memset(buf, 'a', pdata->count);
+	return send_msg(pdata->fd, DONE_REQ, 0);
+}
 
-	clock_gettime(CLOCK_MONOTONIC, &start);
-	retval = write(pdata->fd, buf, pdata->count);
-	clock_gettime(CLOCK_MONOTONIC, &stop);
+static double per_sec(uint64_t n, struct ping_response *resp)
+{
+	uint64_t duration = ts_to_ns(&resp->duration);
 
-	presp->duration.tv_sec = stop.tv_sec - start.tv_sec;
-	presp->duration.tv_nsec = stop.tv_nsec - start.tv_nsec;
+	return duration ? (double)n * NSEC_PER_SEC / duration : 0;
+}
 
-	printf("Sender DONE.\n");
-	return presp;
+/*
+ * Streams --duration seconds for each write and read size, so that the cost
+ * of small transfers can be compared against batching.
+ */
+static int chunk_sweep_client(struct ping_data *pdata)
+{
+	struct ping_response *sent, received;
+	int command, arg;
+	int64_t lost;
+	int size;
+	int ret;
+
+	ret = send_msg(pdata->fd, CHUNK_SWEEP_REQ, pdata->duration);
+	if (!ret)
+		ret = read_msg(pdata->fd, &command, &arg, -1);
+	if (ret)
+		return ret;
+	if (command != OKAY)
+		return -EPROTO;
+
+	printf("%8s %12s %10s %8s %12s %10s %8s %8s %8s\n", "Chunk",
+		"Sent B/s", "Writes/s", "TX ns/B", "Recv B/s", "Reads/s",
+		"B/read", "RX ns/B", "Errors");
+
+	for (size = pdata->chunk_from; size <= pdata->chunk_to; size *= 2) {
+		pdata->chunk = size;
+
+		ret = send_msg(pdata->fd, STEP_REQ, size);
+		if (!ret)
+			ret = read_msg(pdata->fd, &command, &arg, -1);
+		if (ret)
+			return ret;
+		if (command != OKAY)
+			return -EPROTO;
+
+		sent = (struct ping_response *)stream_sender_func(pdata);
+		if (!sent)
+			return -ENOMEM;
+
+		ret = sent->retval;
+		if (!ret)
+			ret = read_report(pdata->fd, &received);
+		if (ret) {
+			free(sent);
+			return ret;
+		}
+
+		lost = sent->bytes - received.bytes;
+		if (lost < 0)
+			lost = 0;
+
+		printf("%8d %12.0f %10.0f %8.1f %12.0f %10.0f %8.1f %8.1f %8"
+			PRIu64 "\n", size, resp_rate(sent),
+			per_sec(sent->syscalls, sent),
+			sent->bytes ? (double)sent->cpu_ns / sent->bytes : 0,
+			resp_rate(&received), per_sec(received.reads, &received),
+			received.reads ?
+			(double)received.bytes / received.reads : 0,
+			received.bytes ?
+			(double)received.cpu_ns / received.bytes : 0,
+			received.errors + lost);
+
+		results_add_u64(pdata->results, "steps", 1);
+		results_add_u64(pdata->results, "tx_bytes", sent->bytes);
+		results_add_u64(pdata->results, "rx_bytes", received.bytes);
+		results_add_u64(pdata->results, "errors",
+			received.errors + lost);
+		free(sent);
+
+		if (size > INT_MAX / 2)
+			break;
+	}
+
+	return send_msg(pdata->fd, DONE_REQ, 0);
 }
 
-static void *receiver_func(void *arg)
+/* Serves the steps of both the rate and the chunk size sweep */
+static int sweep_server(struct ping_data *pdata)
 {
-	struct ping_data *pdata = (struct ping_data *)arg;
-	struct ping_response *presp = NULL;
-	int i;
-	char *buf;
-	struct timespec start, stop;
-	ssize_t read_bytes, read_count;
+	struct ping_response *resp;
+	int command, arg;
+	int ret;
 
-	if (!pdata)
-		return NULL;
+	while (1) {
+		ret = read_msg(pdata->fd, &command, &arg, -1);
+		if (ret)
+			return ret;
+
+		if (command == DONE_REQ)
+			return 0;
+		if (command != STEP_REQ)
+			return -EPROTO;
+
+		if (pdata->chunk_sweep) {
+			if (arg <= 0)
+				return -EPROTO;
+			pdata->rx_size = arg;
+		}
 
-	presp = (struct ping_response *)calloc(1, sizeof(struct ping_response));
-	if (!presp)
-		return NULL;
+		ret = send_msg(pdata->fd, OKAY, 0);
+		if (ret)
+			return ret;
 
-	buf = (char *)malloc(pdata->count);
-	if (!buf) {
-		presp->retval = -ENOMEM;
-		return presp;
+		resp = (struct ping_response *)stream_receiver_func(pdata);
+		if (!resp)
+			return -ENOMEM;
+
+		results_add_u64(pdata->results, "steps", 1);
+		results_add_u64(pdata->results, "rx_bytes", resp->bytes);
+		results_add_u64(pdata->results, "errors", resp->errors +
+			resp->frames.lost + resp->frames.corrupted);
+
+		ret = send_report(pdata->fd, resp);
+		free(resp);
+		if (ret)
+			return ret;
 	}
+}
 
-	clock_gettime(CLOCK_MONOTONIC, &start);
+static int pingpong_client(struct ping_data *pdata)
+{
+	struct ping_frame frame, echo;
+	uint64_t start;
+	uint32_t seq;
+	int ret;
 
-	read_count = 0;
-	do {
-		read_bytes = read(pdata->fd, buf + read_bytes,
-				pdata->count - read_count);
-		if (read_bytes < 0) {
-			/* read error */
-			presp->retval = -errno;
-			return presp;
+	pdata->rtt = (struct histogram *)malloc(sizeof(struct histogram));
+	if (!pdata->rtt)
+		return -ENOMEM;
+
+	hist_init(pdata->rtt);
+
+	for (seq = 0; seq < pdata->count; seq++) {
+		frame.magic = htonl(PING_FRAME_MAGIC);
+		frame.seq = htonl(seq);
+
+		start = now_ns();
+		ret = write_full(pdata->fd, &frame, sizeof(frame));
+		if (ret)
+			return ret;
+
+		ret = read_full(pdata->fd, &echo, sizeof(echo),
+			PING_RTT_TIMEOUT_MS);
+		if (ret == -ETIMEDOUT) {
+			/* Drop any partial frame and go on with the next one */
+			pdata->lost++;
+			tcflush(pdata->fd, TCIFLUSH);
+			continue;
 		}
-		read_count += read_bytes;
-	} while (read_count < pdata->count);
+		if (ret)
+			return ret;
 
-	clock_gettime(CLOCK_MONOTONIC, &stop);
+		if (memcmp(&frame, &echo, sizeof(frame))) {
+			pdata->errors++;
+			tcflush(pdata->fd, TCIFLUSH);
+			continue;
+		}
 
-	for (i = 0; i < pdata->count; i++)
-		if (buf[i] != 'a') {
-			presp->retval = -EINVAL;
-			return presp;
+		hist_record(pdata->rtt, now_ns() - start);
+	}
+
+	return 0;
+}
+
+static int pingpong_server(struct ping_data *pdata)
+{
+	struct ping_frame frame;
+	uint32_t seq;
+	int ret;
+
+	for (seq = 0; seq < pdata->count; seq++) {
+		ret = read_full(pdata->fd, &frame, sizeof(frame),
+			PING_START_TIMEOUT_MS);
+		if (ret)
+			return ret;
+
+		ret = write_full(pdata->fd, &frame, sizeof(frame));
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Serves the PINGPONG passes of an A/B run, switching ASYNC_LOW_LATENCY
+ * on request. The original flag is restored once the client is done.
+ */
+static int lowlat_ab_server(struct ping_data *pdata)
+{
+	int command, arg, saved, ret;
+
+	saved = serial_get_low_latency(pdata->fd);
+
+	while (1) {
+		ret = read_msg(pdata->fd, &command, &arg, -1);
+		if (ret || command == DONE_REQ)
+			break;
+
+		if (command == LOWLAT_REQ) {
+			ret = send_msg(pdata->fd, saved >= 0 &&
+				!serial_set_low_latency(pdata->fd, arg) ?
+				OKAY : NOK, 0);
+		} else if (command == PINGPONG_REQ) {
+			pdata->count = arg;
+			ret = send_msg(pdata->fd, OKAY, 0);
+			if (!ret)
+				ret = pingpong_server(pdata);
+		} else {
+			ret = -EPROTO;
 		}
+		if (ret)
+			break;
+	}
 
-	presp->duration.tv_sec = stop.tv_sec - start.tv_sec;
-	presp->duration.tv_nsec = stop.tv_nsec - start.tv_nsec;
+	if (saved >= 0)
+		serial_set_low_latency(pdata->fd, saved);
 
-	printf("Receiver DONE.\n");
+	return ret;
+}
 
-	return presp;
+static void print_ab_row(const char *name, uint64_t off, uint64_t on)
+{
+	printf("%-8s %12.1f %12.1f %12.1f %9.1f%%\n", name,
+		(double)off / NSEC_PER_USEC, (double)on / NSEC_PER_USEC,
+		((double)on - off) / NSEC_PER_USEC,
+		off ? 100.0 * ((double)on - off) / off : 0);
+}
+
+static void print_ab(struct ping_data *pdata, struct histogram *rtt[2])
+{
+	static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+	char name[16];
+	unsigned int i;
+
+	if (!rtt[0]->total || !rtt[1]->total) {
+		printf("RTT: no samples\n");
+		return;
+	}
+
+	printf("%-8s %12s %12s %12s %10s\n", "RTT", "off(us)", "on(us)",
+		"delta(us)", "delta");
+	print_ab_row("min", rtt[0]->min, rtt[1]->min);
+	for (i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+		snprintf(name, sizeof(name), "p%g", percentiles[i]);
+		print_ab_row(name, hist_percentile(rtt[0], percentiles[i]),
+			hist_percentile(rtt[1], percentiles[i]));
+	}
+	print_ab_row("max", rtt[0]->max, rtt[1]->max);
+	printf("Lost: %" PRIu64 ", corrupted: %" PRIu64 "\n", pdata->lost,
+		pdata->errors);
+}
+
+static int lowlat_ab_client(struct ping_data *pdata)
+{
+	struct histogram *rtt[2] = { NULL, NULL };
+	int command, arg, saved, pass, ret;
+
+	/* The peer's flag may still make a difference */
+	saved = serial_get_low_latency(pdata->fd);
+	if (saved < 0)
+		printf("ASYNC_LOW_LATENCY is not supported locally\n");
+
+	ret = send_msg(pdata->fd, AB_REQ, 0);
+	if (!ret)
+		ret = read_msg(pdata->fd, &command, &arg, -1);
+	if (!ret && command != OKAY)
+		ret = -EPROTO;
+
+	for (pass = 0; pass < 2 && !ret; pass++) {
+		ret = send_msg(pdata->fd, LOWLAT_REQ, pass);
+		if (!ret)
+			ret = read_msg(pdata->fd, &command, &arg, -1);
+		if (ret)
+			break;
+		if (command != OKAY)
+			printf("The peer could not %s ASYNC_LOW_LATENCY\n",
+				pass ? "set" : "clear");
+
+		if (saved >= 0)
+			ret = serial_set_low_latency(pdata->fd, pass);
+		if (!ret)
+			ret = send_msg(pdata->fd, PINGPONG_REQ, pdata->count);
+		if (!ret)
+			ret = read_msg(pdata->fd, &command, &arg, -1);
+		if (!ret && command != OKAY)
+			ret = -EPROTO;
+		if (!ret)
+			ret = pingpong_client(pdata);
+
+		rtt[pass] = pdata->rtt;
+		pdata->rtt = NULL;
+	}
+
+	if (!ret)
+		ret = send_msg(pdata->fd, DONE_REQ, 0);
+
+	if (saved >= 0)
+		serial_set_low_latency(pdata->fd, saved);
+
+	if (!ret) {
+		print_ab(pdata, rtt);
+		results_set_u64(pdata->results, "tx_bytes", (rtt[0]->total +
+			rtt[1]->total + pdata->lost + pdata->errors) *
+			sizeof(struct ping_frame));
+		results_set_u64(pdata->results, "rx_bytes", (rtt[0]->total +
+			rtt[1]->total) * sizeof(struct ping_frame));
+		results_set_u64(pdata->results, "errors", pdata->lost +
+			pdata->errors);
+		results_set_hist(pdata->results, "rtt_off", rtt[0]);
+		results_set_hist(pdata->results, "rtt_on", rtt[1]);
+	}
+
+	free(rtt[0]);
+	free(rtt[1]);
+	return ret;
+}
+
+static void print_response(const char *name, struct ping_response *resp)
+{
+	uint64_t duration = ts_to_ns(&resp->duration);
+
+	printf("%s: %" PRIu64 " bytes in %" PRIu64 " usec (%.0f bytes/s), "
+		"%" PRIu64 " errors\n", name, resp->bytes,
+		(uint64_t)(duration / NSEC_PER_USEC),
+		duration ? (double)resp->bytes * NSEC_PER_SEC / duration : 0,
+		resp->errors);
+
+	if (resp->frames.frames || resp->frames.lost || resp->frames.corrupted)
+		printf("%s: %" PRIu64 " frames, %" PRIu64 " lost, %" PRIu64
+			" corrupted, %" PRIu64 " out of order, %" PRIu64
+			" bytes discarded\n", name, resp->frames.frames,
+			resp->frames.lost, resp->frames.corrupted,
+			resp->frames.out_of_order, resp->frames.discarded);
+
+	if (resp->ring_size)
+		printf("%s: ring peak %" PRIu64 " of %" PRIu64 " bytes (%.1f%%), "
+			"full %" PRIu64 " times\n", name, resp->ring_peak,
+			resp->ring_size, 100.0 * resp->ring_peak /
+			resp->ring_size, resp->ring_waits);
+
+	if (resp->bytes)
+		printf("%s: %.1f CPU ns/byte, %" PRIu64 " syscalls "
+			"(%.1f bytes/syscall)\n", name,
+			(double)resp->cpu_ns / resp->bytes, resp->syscalls,
+			resp->syscalls ? (double)resp->bytes / resp->syscalls :
+			0);
+}
+
+/* A byte count with an optional K, M or G binary suffix */
+static int parse_count(const char *arg, uint64_t *count)
+{
+	unsigned long long n;
+	int shift = 0;
+	char *end;
+
+	errno = 0;
+	n = strtoull(arg, &end, 10);
+	if (end == arg || errno || strchr(arg, '-'))
+		return -EINVAL;
+
+	switch (*end) {
+	case 'K':
+		shift = 10;
+		break;
+	case 'M':
+		shift = 20;
+		break;
+	case 'G':
+		shift = 30;
+		break;
+	}
+
+	if (shift)
+		end++;
+	if (*end || n > UINT64_MAX >> shift)
+		return -EINVAL;
+
+	*count = (uint64_t)n << shift;
+	return 0;
 }
 
 static int ping_init(struct cmd *cmd, int argc, char *argv[])
@@ -189,29 +1851,116 @@ static int ping_init(struct cmd *cmd, int argc, char *argv[])
 		{"server", no_argument, 0, 's'},
 		{"count", required_argument, 0, 'n'},
 		{"command", required_argument, 0, 'c'},
+		{"duration", required_argument, 0, 'd'},
+		{"chunk", required_argument, 0, 'k'},
+		{"interval", required_argument, 0, 'i'},
+		{"framed", no_argument, 0, 'f'},
+		{"engine", required_argument, 0, 'e'},
+		{"io", required_argument, 0, 'I'},
+		{"rate", required_argument, 0, 'r'},
+		{"rate-sweep", optional_argument, 0, 'R'},
+		{"chunk-sweep", optional_argument, 0, 'K'},
+		{"low-latency-ab", no_argument, 0, 'a'},
+		{"ring", required_argument, 0, 'b'},
 		{0, 0, 0, 0}
 	};
 
+	pdata->chunk = PING_CHUNK_SIZE;
+	pdata->interval_ms = PING_INTERVAL_MS;
+	pdata->rx_size = PING_RX_BUF_SIZE;
+	pdata->ring_size = PING_RING_SIZE;
+
 	while (1) {
 		int option_index = 0;
 
-		c = getopt_long(argc, argv, "st:c:n:", long_options,
+		c = getopt_long(argc, argv, "st:c:n:d:k:i:fe:I:r:R::K::ab:", long_options,
 				&option_index);
 		if (c == -1)
 			break;
 
 		switch (c) {
 		case 'n':
-			pdata->count = atoi(optarg);
+			if (parse_count(optarg, &pdata->count)) {
+				ret = -EINVAL;
+				goto e_exit;
+			}
 			break;
 		case 's':
 			pdata->server = 1;
 			break;
+		case 'd':
+			pdata->duration = atoi(optarg);
+			break;
+		case 'k':
+			pdata->chunk = atoi(optarg);
+			break;
+		case 'i':
+			pdata->interval_ms = atoi(optarg);
+			break;
+		case 'f':
+			pdata->framed = 1;
+			break;
+		case 'e':
+			if (strcmp(optarg, "threads") == 0) {
+				pdata->engine = PING_ENGINE_THREADS;
+			} else if (strcmp(optarg, "epoll") == 0) {
+				pdata->engine = PING_ENGINE_EPOLL;
+			} else {
+				ret = -EINVAL;
+				goto e_exit;
+			}
+			break;
+		case 'I':
+			if (strcmp(optarg, "classic") == 0) {
+				pdata->io = PING_IO_CLASSIC;
+			} else if (strcmp(optarg, "uring") == 0) {
+				pdata->io = PING_IO_URING;
+			} else {
+				ret = -EINVAL;
+				goto e_exit;
+			}
+			break;
+		case 'r':
+			pdata->rate = atof(optarg);
+			if (strchr(optarg, '%'))
+				pdata->rate_pct = 1;
+			break;
+		case 'R':
+			pdata->sweep = 1;
+			pdata->sweep_from = 10;
+			pdata->sweep_to = 110;
+			pdata->sweep_step = 10;
+			if (optarg && sscanf(optarg, "%d:%d:%d",
+					&pdata->sweep_from, &pdata->sweep_to,
+					&pdata->sweep_step) != 3) {
+				ret = -EINVAL;
+				goto e_exit;
+			}
+			break;
+		case 'K':
+			pdata->chunk_sweep = 1;
+			pdata->chunk_from = 1;
+			pdata->chunk_to = 65536;
+			if (optarg && sscanf(optarg, "%d:%d",
+					&pdata->chunk_from,
+					&pdata->chunk_to) != 2) {
+				ret = -EINVAL;
+				goto e_exit;
+			}
+			break;
+		case 'a':
+			pdata->ab = 1;
+			break;
+		case 'b':
+			pdata->ring_size = atoi(optarg);
+			break;
 		case 'c':
 			if (strcmp(optarg, "SEND") == 0) {
 				pdata->cmd = SEND_REQ;
 			} else if (strcmp(optarg, "SEND_RECV") == 0) {
 				pdata->cmd = SEND_RECV_REQ;
+			} else if (strcmp(optarg, "PINGPONG") == 0) {
+				pdata->cmd = PINGPONG_REQ;
 			} else {
 				ret = -EINVAL;
 				goto e_exit;
@@ -220,19 +1969,116 @@ static int ping_init(struct cmd *cmd, int argc, char *argv[])
 		}
 	}
 
+	if (pdata->chunk <= 0 || pdata->interval_ms <= 0 ||
+			pdata->duration < 0 || pdata->ring_size < 0) {
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	if (pdata->framed && (pdata->chunk < FRAME_OVERHEAD ||
+			pdata->chunk > FRAME_MAX_SIZE)) {
+		fprintf(stderr, "Frame size must be between %d and %d\n",
+			FRAME_OVERHEAD, FRAME_MAX_SIZE);
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	if ((pdata->rate < 0) || ((pdata->rate || pdata->sweep) &&
+			(!pdata->duration ||
+			 pdata->engine != PING_ENGINE_THREADS))) {
+		fprintf(stderr, "--rate and --rate-sweep need --duration "
+			"and the threads engine\n");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	if (pdata->io == PING_IO_URING) {
+#ifndef HAVE_IO_URING
+		fprintf(stderr, "io_uring support was not built in\n");
+		ret = -ENOTSUP;
+		goto e_exit;
+#endif
+		/*
+		 * The reads in flight are run by io-wq workers and may take
+		 * their bytes off the tty out of stream order, which only
+		 * unframed data survives.
+		 */
+		if (pdata->engine != PING_ENGINE_THREADS || pdata->rate ||
+				pdata->sweep || pdata->chunk_sweep || pdata->ab ||
+				pdata->framed) {
+			fprintf(stderr, "--io=uring needs the threads engine, "
+				"unframed data and no rate or A/B mode\n");
+			ret = -EINVAL;
+			goto e_exit;
+		}
+	}
+
+	if (pdata->chunk_sweep && (!pdata->duration || pdata->framed ||
+			pdata->sweep || pdata->ab ||
+			pdata->engine != PING_ENGINE_THREADS ||
+			pdata->chunk_from <= 0 ||
+			pdata->chunk_to < pdata->chunk_from)) {
+		fprintf(stderr, "--chunk-sweep needs --duration, the threads "
+			"engine and unframed data\n");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	if (pdata->sweep && (pdata->sweep_from <= 0 ||
+			pdata->sweep_step <= 0 ||
+			pdata->sweep_to < pdata->sweep_from)) {
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	if (pdata->ab)
+		pdata->cmd = PINGPONG_REQ;
+
+	if (pdata->cmd == PINGPONG_REQ && pdata->count > INT_MAX) {
+		fprintf(stderr, "PINGPONG runs at most %d exchanges\n",
+			INT_MAX);
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	/* Sweep steps are only scored by counting frames */
+	if (pdata->sweep)
+		pdata->framed = 1;
+
+	if (pdata->duration && pdata->cmd != PINGPONG_REQ) {
+		if (pdata->cmd == SEND_REQ)
+			pdata->cmd = STREAM_REQ;
+		else if (pdata->cmd == SEND_RECV_REQ)
+			pdata->cmd = STREAM_RECV_REQ;
+	}
+
 	if (optind != argc - 1) {
 		fprintf(stderr, "Please specify the tty device");
 		ret = -EINVAL;
 		goto e_exit;
 	}
 
-	pdata->fd = open(argv[optind], O_RDWR | O_NOCTTY);
+	pdata->fd = cmd_open_port(cmd, argv[optind], PORT_FLUSH,
+		pdata->interval_ms);
 	if (pdata->fd < 0) {
-		ret = -ENOENT;
+		ret = pdata->fd;
 		goto e_exit;
 	}
 
-	tcflush(pdata->fd, TCIFLUSH);
+	if (pdata->rate_pct) {
+		pdata->rate = serial_line_rate(pdata->fd) * pdata->rate / 100;
+		if (pdata->rate <= 0) {
+			fprintf(stderr, "Unable to determine the line rate\n");
+			ret = -EINVAL;
+			goto e_exit;
+		}
+	}
+
+	pdata->results = &cmd->results;
+	results_set_str(&cmd->results, "role",
+		pdata->server ? "server" : "client");
+	results_set_str(&cmd->results, "io",
+		pdata->io == PING_IO_URING ? "uring" : "classic");
 
 	cmd->priv = (void *) pdata;
 
@@ -249,33 +2095,121 @@ static int ping_exec(struct cmd *cmd)
 	int command;
 	int arg;
 	int ret = 0;
+	int bidir, count64;
 	pthread_attr_t attr;
 
 	if (!pdata)
 		return -EINVAL;
 
-	/* TODO: Add error handling */
-	pthread_attr_init(&attr);
+	ret = pthread_attr_init(&attr);
+	if (ret)
+		return -ret;
 
 	if (pdata->server) {
-		read_cmd(pdata->fd, &pdata->cmd, &arg);
-		pdata->count = arg;
-		pthread_create(&pdata->receiver_id, &attr, &receiver_func,
-			(void *)pdata);
-		send_cmd(pdata->fd, OKAY, 0);
-		if (pdata->cmd == SEND_RECV_REQ)
-			/* TODO: Check if delay is required */
-			pthread_create(&pdata->sender_id, &attr, &sender_func,
-				(void *)pdata);
+		ret = read_msg(pdata->fd, &command, &arg, -1);
+		if (ret)
+			goto e_exit;
+		pdata->cmd = command & PING_CMD_MASK;
+		pdata->framed = !!(command & PING_FLAG_FRAMED);
+		if (pdata->cmd == PINGPONG_REQ) {
+			pdata->count = arg;
+			ret = send_msg(pdata->fd, OKAY, 0);
+			if (!ret)
+				ret = pingpong_server(pdata);
+			goto e_exit;
+		}
+		if (pdata->cmd == AB_REQ) {
+			ret = send_msg(pdata->fd, OKAY, 0);
+			if (!ret)
+				ret = lowlat_ab_server(pdata);
+			goto e_exit;
+		}
+		if (pdata->cmd == SWEEP_REQ) {
+			pdata->sweep = 1;
+			pdata->duration = arg;
+			ret = send_msg(pdata->fd, OKAY, 0);
+			if (!ret)
+				ret = sweep_server(pdata);
+			goto e_exit;
+		}
+		if (pdata->cmd == CHUNK_SWEEP_REQ) {
+			pdata->chunk_sweep = 1;
+			pdata->duration = arg;
+			ret = send_msg(pdata->fd, OKAY, 0);
+			if (!ret)
+				ret = sweep_server(pdata);
+			goto e_exit;
+		}
+		if (pdata->cmd == STREAM_REQ || pdata->cmd == STREAM_RECV_REQ)
+			pdata->duration = arg;
+		else
+			pdata->count = (uint32_t)arg;
+		if (command & PING_FLAG_COUNT64) {
+			ret = read_msg(pdata->fd, &command, &arg, -1);
+			if (!ret && command != COUNT_HI)
+				ret = -EPROTO;
+			if (ret)
+				goto e_exit;
+			pdata->count |= (uint64_t)(uint32_t)arg << 32;
+		}
+		bidir = pdata->cmd == SEND_RECV_REQ ||
+			pdata->cmd == STREAM_RECV_REQ;
+
+		if (pdata->engine == PING_ENGINE_EPOLL) {
+			ret = send_msg(pdata->fd, OKAY, 0);
+			if (!ret)
+				ret = ping_run_evloop(pdata, bidir, 1);
+			goto e_exit;
+		}
+
+		ret = -start_receiver(pdata, &attr);
+		if (!ret)
+			ret = send_msg(pdata->fd, OKAY, 0);
+		/*
+		 * The data may follow the OKAY right away: the client reads
+		 * the OKAY before it starts its own receiver.
+		 */
+		if (!ret && bidir)
+			ret = -start_sender(pdata, &attr);
+	} else if (pdata->sweep) {
+		ret = rate_sweep_client(pdata);
+	} else if (pdata->chunk_sweep) {
+		ret = chunk_sweep_client(pdata);
+	} else if (pdata->ab) {
+		ret = lowlat_ab_client(pdata);
 	} else {
-		send_cmd(pdata->fd, pdata->cmd, pdata->count);
-		if (pdata->cmd == SEND_RECV_REQ)
-			pthread_create(&pdata->receiver_id, &attr,
-				&receiver_func, (void *)pdata);
-		read_cmd(pdata->fd, &command, &arg);
-		if (command == OKAY)
-			pthread_create(&pdata->sender_id, &attr, &sender_func,
-				(void *)pdata);
+		count64 = !pdata->duration && pdata->count > UINT32_MAX;
+		ret = send_msg(pdata->fd,
+			pdata->cmd | (pdata->framed ? PING_FLAG_FRAMED : 0) |
+			(count64 ? PING_FLAG_COUNT64 : 0),
+			pdata->duration ? (uint32_t)pdata->duration :
+			(uint32_t)pdata->count);
+		if (!ret && count64)
+			ret = send_msg(pdata->fd, COUNT_HI, pdata->count >> 32);
+		if (!ret)
+			ret = read_msg(pdata->fd, &command, &arg, -1);
+		if (!ret && command != OKAY)
+			ret = -EPROTO;
+		if (ret)
+			goto e_exit;
+
+		bidir = pdata->cmd == SEND_RECV_REQ ||
+			pdata->cmd == STREAM_RECV_REQ;
+
+		if (pdata->cmd == PINGPONG_REQ) {
+			ret = pingpong_client(pdata);
+		} else if (pdata->engine == PING_ENGINE_EPOLL) {
+			ret = ping_run_evloop(pdata, 1, bidir);
+		} else {
+			/*
+			 * Start the receiver only after the response was
+			 * consumed, otherwise it may swallow the OKAY.
+			 */
+			if (bidir)
+				ret = -start_receiver(pdata, &attr);
+			if (!ret)
+				ret = -start_sender(pdata, &attr);
+		}
 	}
 
 e_exit:
@@ -302,7 +2236,78 @@ static int ping_cleanup(struct cmd *cmd)
 	if (pdata->receiver_id)
 		pthread_join(pdata->receiver_id, &receiver_ret);
 
-	if (!pdata->server) {
+	if (pdata->engine == PING_ENGINE_EPOLL) {
+		sender_ret = pdata->ev_sender;
+		receiver_ret = pdata->ev_receiver;
+	}
+
+	if (sender_ret) {
+		resp = (struct ping_response *) sender_ret;
+		results_set_rate(&cmd->results, "tx", resp->bytes,
+			ts_to_ns(&resp->duration));
+		results_set_u64(&cmd->results, "tx_cpu_ns", resp->cpu_ns);
+		results_set_u64(&cmd->results, "tx_syscalls", resp->syscalls);
+	}
+
+	if (receiver_ret) {
+		resp = (struct ping_response *) receiver_ret;
+		results_set_rate(&cmd->results, "rx", resp->bytes,
+			ts_to_ns(&resp->duration));
+		results_set_u64(&cmd->results, "rx_cpu_ns", resp->cpu_ns);
+		results_set_u64(&cmd->results, "rx_syscalls", resp->syscalls);
+		if (resp->ring_size) {
+			results_set_u64(&cmd->results, "rx_ring_peak_bytes",
+				resp->ring_peak);
+			results_set_u64(&cmd->results, "rx_ring_full",
+				resp->ring_waits);
+		}
+		results_set_u64(&cmd->results, "errors", resp->errors +
+			resp->frames.lost + resp->frames.corrupted +
+			resp->frames.out_of_order);
+		if (pdata->framed) {
+			results_set_u64(&cmd->results, "frames",
+				resp->frames.frames);
+			results_set_u64(&cmd->results, "frames_lost",
+				resp->frames.lost);
+			results_set_u64(&cmd->results, "frames_corrupted",
+				resp->frames.corrupted);
+			results_set_u64(&cmd->results, "frames_out_of_order",
+				resp->frames.out_of_order);
+		}
+	}
+
+	if (pdata->rtt) {
+		results_set_u64(&cmd->results, "tx_bytes", (pdata->rtt->total +
+			pdata->lost + pdata->errors) *
+			sizeof(struct ping_frame));
+		results_set_u64(&cmd->results, "rx_bytes", pdata->rtt->total *
+			sizeof(struct ping_frame));
+		results_set_u64(&cmd->results, "errors", pdata->lost +
+			pdata->errors);
+		results_set_u64(&cmd->results, "lost", pdata->lost);
+		results_set_hist(&cmd->results, "rtt", pdata->rtt);
+	}
+
+	if (pdata->cmd == PINGPONG_REQ) {
+		if (pdata->rtt) {
+			hist_print(pdata->rtt, "RTT", stdout);
+			printf("Lost: %" PRIu64 ", corrupted: %" PRIu64 "\n",
+				pdata->lost, pdata->errors);
+		}
+	} else if (pdata->duration || pdata->engine == PING_ENGINE_EPOLL) {
+		if (sender_ret) {
+			resp = (struct ping_response *) sender_ret;
+			print_response("Sender", resp);
+			retval = resp->retval;
+		}
+
+		if (receiver_ret) {
+			resp = (struct ping_response *) receiver_ret;
+			print_response("Receiver", resp);
+			if (!retval)
+				retval = resp->retval;
+		}
+	} else if (!pdata->server) {
 		if (!sender_ret) {
 			retval = -EINVAL;
 			goto e_exit;
@@ -319,9 +2324,21 @@ static int ping_cleanup(struct cmd *cmd)
 			resp->duration.tv_nsec / 1000;
 
 		printf("Receiver took %ld usec.\n", duration);
+	} else {
+		/* Burst server: the receiver holds the frame check results */
+		if (sender_ret)
+			retval = ((struct ping_response *)sender_ret)->retval;
+
+		if (receiver_ret) {
+			resp = (struct ping_response *) receiver_ret;
+			print_response("Receiver", resp);
+			if (!retval)
+				retval = resp->retval;
+		}
 	}
 
 e_exit:
+	free(pdata->rtt);
 	free(pdata);
 
 	if (sender_ret)
@@ -341,5 +2358,7 @@ REGISTER_CMD(
 	ping_help,
 	ping_init,
 	ping_exec,
-	ping_cleanup
+	ping_cleanup,
+	.flags = CMD_MULTIPORT,
+	.peer_opt = "-s"
 );
@@ -0,0 +1,258 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <asm/termbits.h>
+
+#include "port.h"
+#include "transport.h"
+
+/* The modem outputs cached by the port */
+#define PORT_MCTRL_OUTPUTS	(TIOCM_DTR | TIOCM_RTS)
+
+void port_init(struct port *port)
+{
+	port->fd = -1;
+	port->tio = NULL;
+	port->mctrl = -1;
+	port->held = NULL;
+}
+
+int port_open(struct port *port, const char *path, unsigned int flags)
+{
+	port_init(port);
+
+	port->fd = transport_open(path, O_RDWR | O_NOCTTY);
+	if (port->fd < 0)
+		return -errno;
+
+	if (flags & PORT_FLUSH)
+		ioctl(port->fd, TCFLSH, TCIFLUSH);
+
+	return 0;
+}
+
+int port_dup(struct port *port, struct port *held)
+{
+	port_init(port);
+
+	port->fd = fcntl(held->fd, F_DUPFD_CLOEXEC, 0);
+	if (port->fd < 0)
+		return -errno;
+
+	/* The status flags are shared, drop those a previous user set */
+	if (fcntl(port->fd, F_SETFL, 0) == -1) {
+		close(port->fd);
+		port->fd = -1;
+		return -errno;
+	}
+
+	if (held->tio) {
+		port->tio = malloc(sizeof(struct termios2));
+		if (port->tio)
+			memcpy(port->tio, held->tio, sizeof(struct termios2));
+	}
+	port->mctrl = held->mctrl;
+	port->held = held;
+
+	return 0;
+}
+
+void port_close(struct port *port)
+{
+	if (port->held) {
+		free(port->held->tio);
+		port->held->tio = port->tio;
+		port->held->mctrl = port->mctrl;
+		port->tio = NULL;
+	}
+
+	if (port->fd >= 0)
+		close(port->fd);
+	free(port->tio);
+	port_init(port);
+}
+
+void port_invalidate(struct port *port)
+{
+	free(port->tio);
+	port->tio = NULL;
+	port->mctrl = -1;
+}
+
+static struct termios2 *port_termios(struct port *port)
+{
+	struct termios2 *tio = (struct termios2 *)port->tio;
+
+	if (tio)
+		return tio;
+
+	tio = (struct termios2 *)malloc(sizeof(*tio));
+	if (!tio) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (ioctl(port->fd, TCGETS2, tio)) {
+		free(tio);
+		return NULL;
+	}
+
+	port->tio = tio;
+	return tio;
+}
+
+int port_get_termios(struct port *port, struct termios2 *tio)
+{
+	struct termios2 *cached = port_termios(port);
+
+	if (!cached)
+		return -errno;
+
+	memcpy(tio, cached, sizeof(*tio));
+	return 0;
+}
+
+int port_set_termios(struct port *port, const struct termios2 *tio)
+{
+	struct termios2 *cached = port_termios(port);
+
+	if (cached && memcmp(cached, tio, sizeof(*tio)) == 0)
+		return 0;
+
+	if (ioctl(port->fd, TCSETS2, tio)) {
+		port_invalidate(port);
+		return -errno;
+	}
+
+	/* B0 and CRTSCTS change what happens to the modem lines */
+	port->mctrl = -1;
+	if (cached)
+		memcpy(cached, tio, sizeof(*tio));
+
+	return 0;
+}
+
+int port_set_iflag(struct port *port, unsigned int set, unsigned int clear)
+{
+	struct termios2 tio;
+	int ret;
+
+	ret = port_get_termios(port, &tio);
+	if (ret)
+		return ret;
+
+	tio.c_iflag &= ~clear;
+	tio.c_iflag |= set;
+
+	return port_set_termios(port, &tio);
+}
+
+int port_get_baudrate(struct port *port)
+{
+	struct termios2 *tio = port_termios(port);
+
+	if (!tio)
+		return -errno;
+
+	return tio->c_ospeed;
+}
+
+int port_set_baudrate(struct port *port, int baudrate)
+{
+	struct termios2 tio;
+	int ret;
+
+	ret = port_get_termios(port, &tio);
+	if (ret)
+		return ret;
+
+	tio.c_cflag &= ~CBAUD;
+	tio.c_cflag |= BOTHER;
+	tio.c_ispeed = baudrate;
+	tio.c_ospeed = baudrate;
+
+	return port_set_termios(port, &tio);
+}
+
+int port_get_mctrl(struct port *port)
+{
+	int status;
+
+	/* The inputs change on their own, they are never cached */
+	if (ioctl(port->fd, TIOCMGET, &status) == -1)
+		return -errno;
+
+	return status;
+}
+
+int port_set_mctrl(struct port *port, int set, int clear)
+{
+	struct termios2 *tio;
+	int status;
+
+	if (port->mctrl < 0) {
+		status = port_get_mctrl(port);
+		if (status < 0)
+			return status;
+		port->mctrl = status & PORT_MCTRL_OUTPUTS;
+	}
+
+	/* Only the lines which actually change are touched */
+	set &= PORT_MCTRL_OUTPUTS & ~port->mctrl;
+	clear &= port->mctrl & ~set;
+	if (!set && !clear)
+		goto e_exit;
+
+	if ((set && ioctl(port->fd, TIOCMBIS, &set) == -1) ||
+			(clear && ioctl(port->fd, TIOCMBIC, &clear) == -1)) {
+		port->mctrl = -1;
+		return -errno;
+	}
+
+	port->mctrl = (port->mctrl | set) & ~clear;
+
+e_exit:
+	/* With CRTSCTS the driver throttles through RTS behind our back */
+	tio = port_termios(port);
+	if (!tio || (tio->c_cflag & CRTSCTS))
+		port->mctrl = -1;
+
+	return 0;
+}
+
+int port_set_rts(struct port *port, int level)
+{
+	/* No modem lines on the loopback ends, see transport_set_rts() */
+	if (transport_loopback_enabled())
+		return transport_set_rts(port->fd, level);
+
+	return port_set_mctrl(port, level ? TIOCM_RTS : 0,
+		level ? 0 : TIOCM_RTS);
+}
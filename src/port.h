@@ -0,0 +1,84 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef PORT_H
+#define PORT_H
+
+struct termios2;
+
+/* Discard the pending input once the port is open */
+#define PORT_FLUSH	0x1
+
+/*
+ * An open device with the last termios2 and modem line state read or
+ * written through it, so setting them again to the same value costs no
+ * ioctl. The cache assumes the settings only change through the port,
+ * code changing them behind its back calls port_invalidate().
+ */
+struct port {
+	int fd;		/* -1 when closed */
+	void *tio;	/* cached struct termios2, NULL if unknown */
+	int mctrl;	/* cached TIOCM_DTR and TIOCM_RTS, -1 if unknown */
+	struct port *held;	/* port this one duplicates, or NULL */
+};
+
+void port_init(struct port *port);
+
+/* Opens path through the transport, 0 or a negative error code */
+int port_open(struct port *port, const char *path, unsigned int flags);
+
+/*
+ * Opens a duplicate of a port which stays open, starting from its cache.
+ * Closing the duplicate hands the cache back to the held port, only one
+ * duplicate may be open at a time.
+ */
+int port_dup(struct port *port, struct port *held);
+
+/* Safe to call on a port which was never opened or already closed */
+void port_close(struct port *port);
+
+void port_invalidate(struct port *port);
+
+int port_get_termios(struct port *port, struct termios2 *tio);
+
+int port_set_termios(struct port *port, const struct termios2 *tio);
+
+/* Raises the c_iflag bits of set and drops those of clear */
+int port_set_iflag(struct port *port, unsigned int set, unsigned int clear);
+
+/* Configured baud rate of the port or a negative error code */
+int port_get_baudrate(struct port *port);
+
+/* Arbitrary input and output rate through BOTHER */
+int port_set_baudrate(struct port *port, int baudrate);
+
+/* The TIOCM_* bits or a negative error code */
+int port_get_mctrl(struct port *port);
+
+/* Raises the DTR and RTS bits of set and drops those of clear */
+int port_set_mctrl(struct port *port, int set, int clear);
+
+/* Same as transport_set_rts(), through the modem line cache */
+int port_set_rts(struct port *port, int level);
+
+#endif /* PORT_H */
@@ -0,0 +1,350 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "results.h"
+#include "timeutil.h"
+
+enum results_format results_format = RESULTS_TEXT;
+
+static FILE *results_out;
+
+/* Last CSV header, a new one is printed whenever the columns change */
+static char csv_header[RESULTS_MAX_METRICS * (RESULTS_NAME_LEN + 1) + 32];
+
+static const struct {
+	const char *name;
+	double percentile;
+} hist_percentiles[] = {
+	{ "p50", 50.0 },
+	{ "p90", 90.0 },
+	{ "p99", 99.0 },
+	{ "p99_9", 99.9 },
+};
+
+int results_parse_format(const char *name)
+{
+	if (strcmp(name, "text") == 0)
+		results_format = RESULTS_TEXT;
+	else if (strcmp(name, "json") == 0)
+		results_format = RESULTS_JSON;
+	else if (strcmp(name, "csv") == 0)
+		results_format = RESULTS_CSV;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
+int results_setup(void)
+{
+	int fd;
+
+	if (results_format == RESULTS_TEXT)
+		return 0;
+
+	fflush(stdout);
+
+	fd = dup(STDOUT_FILENO);
+	if (fd < 0)
+		return -errno;
+
+	results_out = fdopen(fd, "w");
+	if (!results_out) {
+		close(fd);
+		return -errno;
+	}
+	setvbuf(results_out, NULL, _IOLBF, 0);
+
+	if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+		return -errno;
+
+	return 0;
+}
+
+void results_clear(struct results *r)
+{
+	r->count = 0;
+	r->overflow = 0;
+}
+
+static struct metric *results_slot(struct results *r, const char *name)
+{
+	struct metric *m;
+	int i;
+
+	for (i = 0; i < r->count; i++)
+		if (strcmp(r->metrics[i].name, name) == 0)
+			return &r->metrics[i];
+
+	if (r->count == RESULTS_MAX_METRICS) {
+		if (!r->overflow)
+			fprintf(stderr, "results: more than %d metrics, dropping "
+				"%s and the following ones\n",
+				RESULTS_MAX_METRICS, name);
+		r->overflow = 1;
+		return NULL;
+	}
+
+	m = &r->metrics[r->count++];
+	snprintf(m->name, sizeof(m->name), "%s", name);
+	m->type = METRIC_U64;
+	m->value.u64 = 0;
+
+	return m;
+}
+
+void results_set_u64(struct results *r, const char *name, uint64_t value)
+{
+	struct metric *m = results_slot(r, name);
+
+	if (!m)
+		return;
+	m->type = METRIC_U64;
+	m->value.u64 = value;
+}
+
+void results_add_u64(struct results *r, const char *name, uint64_t value)
+{
+	struct metric *m = results_slot(r, name);
+
+	if (!m)
+		return;
+	if (m->type != METRIC_U64) {
+		m->type = METRIC_U64;
+		m->value.u64 = 0;
+	}
+	m->value.u64 += value;
+}
+
+void results_set_i64(struct results *r, const char *name, int64_t value)
+{
+	struct metric *m = results_slot(r, name);
+
+	if (!m)
+		return;
+	m->type = METRIC_I64;
+	m->value.i64 = value;
+}
+
+void results_set_double(struct results *r, const char *name, double value)
+{
+	struct metric *m = results_slot(r, name);
+
+	if (!m)
+		return;
+	m->type = METRIC_DOUBLE;
+	m->value.d = value;
+}
+
+void results_set_str(struct results *r, const char *name, const char *value)
+{
+	struct metric *m = results_slot(r, name);
+
+	if (!m)
+		return;
+	m->type = METRIC_STR;
+	m->value.str = value;
+}
+
+void results_set_rate(struct results *r, const char *prefix, uint64_t bytes,
+		uint64_t duration_ns)
+{
+	char name[RESULTS_NAME_LEN];
+
+	snprintf(name, sizeof(name), "%s_bytes", prefix);
+	results_set_u64(r, name, bytes);
+	snprintf(name, sizeof(name), "%s_duration_ns", prefix);
+	results_set_u64(r, name, duration_ns);
+	snprintf(name, sizeof(name), "%s_throughput_Bps", prefix);
+	results_set_double(r, name, duration_ns ?
+		(double)bytes * NSEC_PER_SEC / duration_ns : 0);
+}
+
+void results_set_hist(struct results *r, const char *prefix,
+		const struct histogram *h)
+{
+	char name[RESULTS_NAME_LEN];
+	unsigned int i;
+
+	snprintf(name, sizeof(name), "%s_samples", prefix);
+	results_set_u64(r, name, h->total);
+	snprintf(name, sizeof(name), "%s_min_ns", prefix);
+	results_set_u64(r, name, h->total ? h->min : 0);
+	snprintf(name, sizeof(name), "%s_avg_ns", prefix);
+	results_set_u64(r, name, h->total ? h->sum / h->total : 0);
+
+	for (i = 0; i < sizeof(hist_percentiles) /
+			sizeof(hist_percentiles[0]); i++) {
+		snprintf(name, sizeof(name), "%s_%s_ns", prefix,
+			hist_percentiles[i].name);
+		results_set_u64(r, name,
+			hist_percentile(h, hist_percentiles[i].percentile));
+	}
+
+	snprintf(name, sizeof(name), "%s_max_ns", prefix);
+	results_set_u64(r, name, h->max);
+}
+
+uint64_t results_get_u64(const struct results *r, const char *name)
+{
+	int i;
+
+	for (i = 0; i < r->count; i++) {
+		if (strcmp(r->metrics[i].name, name))
+			continue;
+		if (r->metrics[i].type == METRIC_U64)
+			return r->metrics[i].value.u64;
+		if (r->metrics[i].type == METRIC_I64)
+			return r->metrics[i].value.i64;
+		return 0;
+	}
+
+	return 0;
+}
+
+static void json_string(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; s && *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(out, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(out, "\\u%04x", *s);
+		else
+			fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+static void csv_string(FILE *out, const char *s)
+{
+	if (!s)
+		return;
+
+	if (!strpbrk(s, ",\"\n")) {
+		fputs(s, out);
+		return;
+	}
+
+	fputc('"', out);
+	for (; *s; s++) {
+		if (*s == '"')
+			fputc('"', out);
+		fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+static void emit_value(FILE *out, const struct metric *m)
+{
+	switch (m->type) {
+	case METRIC_U64:
+		fprintf(out, "%" PRIu64, m->value.u64);
+		break;
+	case METRIC_I64:
+		fprintf(out, "%" PRId64, m->value.i64);
+		break;
+	case METRIC_DOUBLE:
+		if (isfinite(m->value.d))
+			fprintf(out, "%.3f", m->value.d);
+		else if (results_format == RESULTS_JSON)
+			fputs("null", out);
+		break;
+	case METRIC_STR:
+		if (results_format == RESULTS_JSON)
+			json_string(out, m->value.str);
+		else
+			csv_string(out, m->value.str);
+		break;
+	}
+}
+
+static void emit_json(const char *cmd, const char *port, int status,
+		const struct results *r)
+{
+	int i;
+
+	fputs("{\"cmd\":", results_out);
+	json_string(results_out, cmd);
+	fputs(",\"port\":", results_out);
+	json_string(results_out, port);
+	fprintf(results_out, ",\"status\":%d", status);
+
+	for (i = 0; i < r->count; i++) {
+		fputc(',', results_out);
+		json_string(results_out, r->metrics[i].name);
+		fputc(':', results_out);
+		emit_value(results_out, &r->metrics[i]);
+	}
+
+	fputs("}\n", results_out);
+}
+
+static void emit_csv(const char *cmd, const char *port, int status,
+		const struct results *r)
+{
+	char header[sizeof(csv_header)];
+	int i, len;
+
+	len = snprintf(header, sizeof(header), "cmd,port,status");
+	for (i = 0; i < r->count; i++)
+		len += snprintf(header + len, sizeof(header) - len, ",%s",
+			r->metrics[i].name);
+
+	if (strcmp(header, csv_header)) {
+		strcpy(csv_header, header);
+		fprintf(results_out, "%s\n", header);
+	}
+
+	csv_string(results_out, cmd);
+	fputc(',', results_out);
+	csv_string(results_out, port);
+	fprintf(results_out, ",%d", status);
+
+	for (i = 0; i < r->count; i++) {
+		fputc(',', results_out);
+		emit_value(results_out, &r->metrics[i]);
+	}
+
+	fputc('\n', results_out);
+}
+
+void results_emit(const char *cmd, const char *port, int status,
+		const struct results *r)
+{
+	if (!results_out)
+		return;
+
+	if (results_format == RESULTS_JSON)
+		emit_json(cmd, port, status, r);
+	else if (results_format == RESULTS_CSV)
+		emit_csv(cmd, port, status, r);
+}
@@ -0,0 +1,104 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stdint.h>
+
+#include "histogram.h"
+
+#define RESULTS_MAX_METRICS	48
+#define RESULTS_NAME_LEN	32
+
+enum results_format {
+	RESULTS_TEXT,
+	RESULTS_JSON,
+	RESULTS_CSV,
+};
+
+enum metric_type {
+	METRIC_U64,
+	METRIC_I64,
+	METRIC_DOUBLE,
+	METRIC_STR,
+};
+
+struct metric {
+	char name[RESULTS_NAME_LEN];
+	enum metric_type type;
+	union {
+		uint64_t u64;
+		int64_t i64;
+		double d;
+		const char *str;	/* must outlive the command */
+	} value;
+};
+
+/*
+ * Typed metrics filled in by a command. Setting a name which already
+ * exists overwrites it, so the order is the order of first appearance.
+ */
+struct results {
+	struct metric metrics[RESULTS_MAX_METRICS];
+	int count;
+	int overflow;	/* set once a metric was dropped for lack of room */
+};
+
+extern enum results_format results_format;
+
+int results_parse_format(const char *name);
+
+/*
+ * For the machine readable formats, stdout is reserved for the records
+ * and the human readable output of the commands goes to stderr.
+ */
+int results_setup(void);
+
+void results_clear(struct results *r);
+
+void results_set_u64(struct results *r, const char *name, uint64_t value);
+
+void results_add_u64(struct results *r, const char *name, uint64_t value);
+
+void results_set_i64(struct results *r, const char *name, int64_t value);
+
+void results_set_double(struct results *r, const char *name, double value);
+
+void results_set_str(struct results *r, const char *name, const char *value);
+
+/* Sets <prefix>_bytes, <prefix>_duration_ns and <prefix>_throughput_Bps */
+void results_set_rate(struct results *r, const char *prefix, uint64_t bytes,
+		uint64_t duration_ns);
+
+/* Sets the sample count, min, avg, max and percentiles as <prefix>_*_ns */
+void results_set_hist(struct results *r, const char *prefix,
+		const struct histogram *h);
+
+uint64_t results_get_u64(const struct results *r, const char *name);
+
+/* Writes one record in the selected format, nothing in text mode */
+void results_emit(const char *cmd, const char *port, int status,
+		const struct results *r);
+
+#endif /* RESULTS_H */
@@ -25,6 +25,7 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,13 +34,31 @@
 #include <unistd.h>
 
 #include "cmd.h"
+#include "histogram.h"
+#include "timeutil.h"
+#include "tty_profile.h"
 const char rts_control_help[] = "Usage:\n"
-	"\t uart_test rts_control [options] <ttyDevice>\n";
+	"\t uart_test rts_control [options] <ttyDevice>\n"
+	"Options:\n"
+	"\t-r, --receiver\t\trun as receiver\n"
+	"\t-s, --sender\t\trun as sender (default)\n"
+	"\t-t, --timeout <sec>\ttimeout (default 20)\n"
+	"\t-l, --latency\t\tstream with CRTSCTS while the receiver\n"
+	"\t\t\t\ttoggles RTS, and measure how long the sender\n"
+	"\t\t\t\tkeeps transmitting after RTS drops and how long\n"
+	"\t\t\t\tit takes to resume after RTS rises\n"
+	"\t-n, --count <n>\t\tRTS cycles in latency mode (default 100)\n"
+	"\t-q, --quiet <ms>\tsilence that ends the transmission after\n"
+	"\t\t\t\tRTS drops (default 50)\n";
 
 struct rts_control_data {
 	int receiver;
 	int fd;
+	struct port *port;
 	int timeout;
+	int latency;
+	int count;
+	int quiet_ms;
 };
 
 static const char *cmd1 = "CMD1";
@@ -49,6 +68,10 @@ static const char *resp_ok = "OKAY";
 static const char *resp_timeout = "TOUT";
 
 static const int default_timeout = 20;
+static const int default_count = 100;
+static const int default_quiet_ms = 50;
+
+#define RTS_LATENCY_CHUNK	64
 
 static int rts_control_init(struct cmd *cmd, int argc, char *argv[])
 {
@@ -64,15 +87,20 @@ static int rts_control_init(struct cmd *cmd, int argc, char *argv[])
 		{"receiver", no_argument, 0, 'r'},
 		{"sender", no_argument, 0, 's'},
 		{"timeout", required_argument, 0, 't'},
+		{"latency", no_argument, 0, 'l'},
+		{"count", required_argument, 0, 'n'},
+		{"quiet", required_argument, 0, 'q'},
 		{0, 0, 0, 0}
 	};
 
 	pdata->timeout = default_timeout;
+	pdata->count = default_count;
+	pdata->quiet_ms = default_quiet_ms;
 
 	while (1) {
 		int option_index = 0;
 
-		c = getopt_long(argc, argv, "rst:", long_options,
+		c = getopt_long(argc, argv, "rst:ln:q:", long_options,
 			&option_index);
 		if (c == -1)
 			break;
@@ -87,6 +115,15 @@ static int rts_control_init(struct cmd *cmd, int argc, char *argv[])
 		case 't':
 			pdata->timeout = atoi(optarg);
 			break;
+		case 'l':
+			pdata->latency = 1;
+			break;
+		case 'n':
+			pdata->count = atoi(optarg);
+			break;
+		case 'q':
+			pdata->quiet_ms = atoi(optarg);
+			break;
 		default:
 			fprintf(stderr, "rts_control: Invalid option %s\n",
 				optarg);
@@ -95,19 +132,24 @@ static int rts_control_init(struct cmd *cmd, int argc, char *argv[])
 		}
 	}
 
+	if (pdata->timeout <= 0 || pdata->count <= 0 || pdata->quiet_ms <= 0) {
+		fprintf(stderr, "rts_control: Invalid parameters\n");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
 	if (optind != argc - 1) {
 		fprintf(stderr, "Please specify the tty device");
 		ret = -EINVAL;
 		goto e_exit;
 	}
 
-	pdata->fd = open(argv[optind], O_RDWR | O_NOCTTY);
+	pdata->fd = cmd_open_port(cmd, argv[optind], PORT_FLUSH, 0);
 	if (pdata->fd < 0) {
-		ret = -ENOENT;
+		ret = pdata->fd;
 		goto e_exit;
 	}
-
-	tcflush(pdata->fd, TCIFLUSH);
+	pdata->port = &cmd->port;
 
 	cmd->priv = (void *) pdata;
 
@@ -143,24 +185,214 @@ static int wait_command(int fd, char *buffer, int timeout)
 	return 0;
 }
 
-static int set_rts(int fd, int level)
+/* Bytes read, 0 if nothing arrived within timeout_ms, or -errno */
+static ssize_t read_some(int fd, char *buf, size_t len, int timeout_ms)
 {
-	int status;
+	struct pollfd pfd;
+	ssize_t count;
+	int ret;
 
-	if (ioctl(fd, TIOCMGET, &status) == -1)
-		return -errno;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	while (1) {
+		ret = poll(&pfd, 1, timeout_ms);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return ret < 0 ? -errno : 0;
+
+		count = read(fd, buf, len);
+		if (count < 0 && errno == EINTR)
+			continue;
+		return count < 0 ? -errno : count;
+	}
+}
 
-	if (level)
-		status |= TIOCM_RTS;
-	else
-		status &= ~TIOCM_RTS;
+/* Reads everything that arrives within timeout_ms of the previous byte */
+static ssize_t read_until_quiet(int fd, int timeout_ms, uint64_t *last_ns)
+{
+	char buf[256];
+	ssize_t count, total = 0;
 
-	if (ioctl(fd, TIOCMSET, &status) == -1)
-		return -errno;
+	while ((count = read_some(fd, buf, sizeof(buf), timeout_ms)) > 0) {
+		if (last_ns)
+			*last_ns = now_ns();
+		total += count;
+	}
+
+	return count < 0 ? count : total;
+}
+
+/*
+ * The sender streams with hardware flow control until the receiver asks
+ * it to stop.
+ */
+static int latency_sender(struct rts_control_data *pdata,
+		struct results *results)
+{
+	char buf[RTS_LATENCY_CHUNK], buffer[10];
+	struct pollfd pfd;
+	uint64_t bytes = 0;
+	ssize_t count;
+	int retval;
+
+	retval = tty_profile_apply_flow(pdata->port, TTY_FLOW_RTSCTS);
+	if (retval)
+		return retval;
+
+	write(pdata->fd, cmd1, 4);
+	retval = wait_command(pdata->fd, buffer, pdata->timeout);
+	if (retval != 0)
+		return retval;
+	if (strncmp(buffer, resp_ok, 4))
+		return -EINVAL;
+
+	memset(buf, 0x55, sizeof(buf));
+	pfd.fd = pdata->fd;
+	pfd.events = POLLIN | POLLOUT;
+
+	while (1) {
+		retval = poll(&pfd, 1, pdata->timeout * 1000);
+		if (retval < 0 && errno == EINTR)
+			continue;
+		if (retval < 0)
+			return -errno;
+		if (retval == 0)
+			return -ETIMEDOUT;
+
+		if (pfd.revents & POLLIN) {
+			retval = wait_command(pdata->fd, buffer, pdata->timeout);
+			if (retval != 0)
+				return retval;
+			if (strncmp(buffer, cmd3, 4))
+				return -EINVAL;
+			break;
+		}
+
+		count = write(pdata->fd, buf, sizeof(buf));
+		if (count < 0 && errno != EINTR)
+			return -errno;
+		if (count > 0)
+			bytes += count;
+	}
+
+	printf("Sent %" PRIu64 " bytes\n", bytes);
+	results_set_u64(results, "tx_bytes", bytes);
 
 	return 0;
 }
 
+/*
+ * Drops and raises RTS while the sender streams. The last byte after the
+ * drop and the first byte after the rise are timestamped as they are read.
+ */
+static int latency_receiver(struct rts_control_data *pdata,
+		struct results *results)
+{
+	struct histogram *drain, *resume;
+	uint64_t drop, rise, last, bytes = 0, after = 0, after_max = 0;
+	char buf[256], buffer[10];
+	ssize_t count;
+	int i, retval;
+
+	drain = (struct histogram *)malloc(sizeof(*drain));
+	resume = (struct histogram *)malloc(sizeof(*resume));
+	if (!drain || !resume) {
+		retval = -ENOMEM;
+		goto e_exit;
+	}
+	hist_init(drain);
+	hist_init(resume);
+
+	retval = wait_command(pdata->fd, buffer, pdata->timeout);
+	if (retval != 0)
+		goto e_exit;
+	if (strncmp(buffer, cmd1, 4)) {
+		retval = -EINVAL;
+		goto e_exit;
+	}
+	write(pdata->fd, resp_ok, 4);
+
+	for (i = 0; i < pdata->count; i++) {
+		/* Let the stream run, then empty the input queue */
+		last = now_ns() + pdata->quiet_ms * NSEC_PER_MSEC;
+		do {
+			count = read_some(pdata->fd, buf, sizeof(buf),
+				pdata->timeout * 1000);
+			if (count <= 0) {
+				retval = count ? count : -ETIMEDOUT;
+				goto e_exit;
+			}
+			bytes += count;
+		} while (now_ns() < last);
+
+		count = read_until_quiet(pdata->fd, 0, NULL);
+		if (count < 0) {
+			retval = count;
+			goto e_exit;
+		}
+		bytes += count;
+
+		retval = port_set_rts(pdata->port, 0);
+		if (retval)
+			goto e_exit;
+		drop = now_ns();
+
+		last = drop;
+		count = read_until_quiet(pdata->fd, pdata->quiet_ms, &last);
+		if (count < 0) {
+			retval = count;
+			goto e_exit;
+		}
+		hist_record(drain, last - drop);
+		bytes += count;
+		after += count;
+		if ((uint64_t)count > after_max)
+			after_max = count;
+
+		retval = port_set_rts(pdata->port, 1);
+		if (retval)
+			goto e_exit;
+		rise = now_ns();
+
+		count = read_some(pdata->fd, buf, sizeof(buf),
+			pdata->timeout * 1000);
+		if (count <= 0) {
+			fprintf(stderr, "Transmission did not resume\n");
+			retval = count ? count : -ETIMEDOUT;
+			goto e_exit;
+		}
+		hist_record(resume, now_ns() - rise);
+		bytes += count;
+	}
+
+	write(pdata->fd, cmd3, 4);
+	count = read_until_quiet(pdata->fd, pdata->quiet_ms, NULL);
+	if (count > 0)
+		bytes += count;
+
+	hist_print(drain, "RTS low to last byte", stdout);
+	hist_print(resume, "RTS high to first byte", stdout);
+	printf("Bytes after RTS low: %.1f average, %" PRIu64 " max\n",
+		(double)after / pdata->count, after_max);
+
+	results_set_u64(results, "rx_bytes", bytes);
+	results_set_u64(results, "cycles", pdata->count);
+	results_set_u64(results, "after_rts_bytes", after);
+	results_set_u64(results, "after_rts_max_bytes", after_max);
+	results_set_hist(results, "drain", drain);
+	results_set_hist(results, "resume", resume);
+
+e_exit:
+	/* Never leave the peer stopped */
+	if (retval)
+		port_set_rts(pdata->port, 1);
+	free(drain);
+	free(resume);
+	return retval;
+}
+
 static int rts_control_exec(struct cmd *cmd)
 {
 	struct rts_control_data *pdata = (struct rts_control_data *)cmd->priv;
@@ -170,6 +402,11 @@ static int rts_control_exec(struct cmd *cmd)
 	if (!pdata)
 		return -EINVAL;
 
+	if (pdata->latency)
+		return pdata->receiver ?
+			latency_receiver(pdata, &cmd->results) :
+			latency_sender(pdata, &cmd->results);
+
 	if (pdata->receiver) {
 		/* Wait for initial command */
 		retval = wait_command(pdata->fd, buffer, pdata->timeout);
@@ -181,7 +418,7 @@ static int rts_control_exec(struct cmd *cmd)
 			return -EINVAL;
 
 		/* Deassert RTS*/
-		retval = set_rts(pdata->fd, 0);
+		retval = port_set_rts(pdata->port, 0);
 		if (retval)
 			return retval;
 
@@ -196,7 +433,7 @@ static int rts_control_exec(struct cmd *cmd)
 		}
 
 		/* restore RTS operation*/
-		retval = set_rts(pdata->fd, 1);
+		retval = port_set_rts(pdata->port, 1);
 		if (retval)
 			return retval;
 
@@ -250,5 +487,6 @@ REGISTER_CMD(
 	rts_control_help,
 	rts_control_init,
 	rts_control_exec,
-	rts_control_cleanup
+	rts_control_cleanup,
+	.peer_opt = "-r"
 );
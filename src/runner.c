@@ -0,0 +1,415 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <glob.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmd.h"
+#include "results.h"
+#include "runner.h"
+#include "timeutil.h"
+#include "transport.h"
+
+struct runner_opts runner_opts;
+
+struct runner_job {
+	struct cmd cmd;
+	int argc;
+	char **argv;
+	const char *port;
+	int initialized;
+	int ret;
+	int cpu;
+	uint64_t start_ns;
+	uint64_t end_ns;
+};
+
+struct runner {
+	struct runner_job *jobs;
+	int njobs;
+	int next;
+};
+
+int parse_cpu_list(const char *list, int **cpus, int *ncpus)
+{
+	const char *p = list;
+	char *end;
+	long first, last, cpu;
+	int *array = NULL, *tmp, count = 0;
+
+	while (*p) {
+		first = strtol(p, &end, 10);
+		if (end == p || first < 0)
+			goto e_inval;
+
+		last = first;
+		if (*end == '-') {
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if (end == p || last < first)
+				goto e_inval;
+		}
+
+		for (cpu = first; cpu <= last; cpu++) {
+			tmp = realloc(array, (count + 1) * sizeof(*array));
+			if (!tmp) {
+				free(array);
+				return -ENOMEM;
+			}
+			array = tmp;
+			array[count++] = cpu;
+		}
+
+		if (*end == ',')
+			end++;
+		else if (*end)
+			goto e_inval;
+		p = end;
+	}
+
+	if (!count)
+		return -EINVAL;
+
+	*cpus = array;
+	*ncpus = count;
+	return 0;
+
+e_inval:
+	free(array);
+	return -EINVAL;
+}
+
+int expand_ports(const char *spec, char ***ports, int *nports)
+{
+	glob_t g;
+	char *list, *token, *saveptr = NULL;
+	int flags = GLOB_NOCHECK, ret = 0;
+	size_t i;
+
+	list = strdup(spec);
+	if (!list)
+		return -ENOMEM;
+
+	memset(&g, 0, sizeof(g));
+
+	for (token = strtok_r(list, ",", &saveptr); token;
+			token = strtok_r(NULL, ",", &saveptr)) {
+		if (glob(token, flags, NULL, &g)) {
+			ret = -ENOMEM;
+			goto e_exit;
+		}
+		flags |= GLOB_APPEND;
+	}
+
+	*nports = 0;
+	*ports = (char **)calloc(g.gl_pathc ? g.gl_pathc : 1, sizeof(char *));
+	if (!*ports) {
+		ret = -ENOMEM;
+		goto e_exit;
+	}
+
+	for (i = 0; i < g.gl_pathc; i++) {
+		(*ports)[i] = strdup(g.gl_pathv[i]);
+		if (!(*ports)[i]) {
+			free_ports(*ports, i);
+			ret = -ENOMEM;
+			goto e_exit;
+		}
+		(*nports)++;
+	}
+
+e_exit:
+	globfree(&g);
+	free(list);
+	return ret;
+}
+
+void free_ports(char **ports, int nports)
+{
+	int i;
+
+	for (i = 0; i < nports; i++)
+		free(ports[i]);
+	free(ports);
+}
+
+/* Pins the calling thread to cpu, or gives it back the saved mask if < 0 */
+static int pin_to_cpu(int cpu, const cpu_set_t *saved)
+{
+	cpu_set_t set;
+
+	if (cpu < 0)
+		return -pthread_setaffinity_np(pthread_self(), sizeof(*saved),
+			saved);
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	return -pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *runner_worker(void *arg)
+{
+	struct runner *runner = (struct runner *)arg;
+	struct runner_job *job;
+	cpu_set_t saved;
+	int idx, ret, pinned = 0, can_restore;
+
+	/* The main thread may run jobs too, it must not stay pinned */
+	can_restore = !pthread_getaffinity_np(pthread_self(), sizeof(saved),
+		&saved);
+
+	while ((idx = __atomic_fetch_add(&runner->next, 1,
+			__ATOMIC_RELAXED)) < runner->njobs) {
+		job = &runner->jobs[idx];
+		if (!job->initialized)
+			continue;
+
+		/* Threads created by the command inherit the affinity */
+		if (job->cpu >= 0) {
+			ret = pin_to_cpu(job->cpu, &saved);
+			if (ret)
+				fprintf(stderr, "%s: failed to pin to CPU %d\n",
+					job->port, job->cpu);
+			else
+				pinned = can_restore;
+		} else if (pinned) {
+			pin_to_cpu(-1, &saved);
+			pinned = 0;
+		}
+
+		job->start_ns = now_ns();
+		job->ret = finish_cmd(&job->cmd);
+		job->end_ns = now_ns();
+	}
+
+	if (pinned)
+		pin_to_cpu(-1, &saved);
+
+	return NULL;
+}
+
+static void runner_report(struct runner *runner, const char *name,
+		uint64_t wall_ns)
+{
+	struct runner_job *job;
+	struct results total;
+	uint64_t tx = 0, rx = 0, errors = 0, duration;
+	uint64_t job_tx, job_rx, job_errors;
+	int i, failed = 0;
+
+	printf("%-24s %6s %4s %10s %12s %12s %8s %14s\n", "Port", "Status",
+		"CPU", "Time(ms)", "TX bytes", "RX bytes", "Errors",
+		"Bytes/s");
+
+	for (i = 0; i < runner->njobs; i++) {
+		job = &runner->jobs[i];
+		duration = job->end_ns - job->start_ns;
+		job_tx = results_get_u64(&job->cmd.results, "tx_bytes");
+		job_rx = results_get_u64(&job->cmd.results, "rx_bytes");
+		job_errors = results_get_u64(&job->cmd.results, "errors");
+
+		printf("%-24s %6d %4d %10.1f %12" PRIu64 " %12" PRIu64
+			" %8" PRIu64 " %14.0f\n", job->port, job->ret,
+			job->cpu, (double)duration / NSEC_PER_MSEC,
+			job_tx, job_rx, job_errors, duration ?
+			(double)(job_tx + job_rx) * NSEC_PER_SEC / duration :
+			0);
+
+		results_set_i64(&job->cmd.results, "cpu", job->cpu);
+		results_emit(name, job->port, job->ret, &job->cmd.results);
+
+		tx += job_tx;
+		rx += job_rx;
+		errors += job_errors;
+		if (job->ret)
+			failed++;
+	}
+
+	printf("%-24s %6d %4s %10.1f %12" PRIu64 " %12" PRIu64 " %8" PRIu64
+		" %14.0f\n", "Total", failed, "", (double)wall_ns /
+		NSEC_PER_MSEC, tx, rx, errors, wall_ns ?
+		(double)(tx + rx) * NSEC_PER_SEC / wall_ns : 0);
+
+	results_clear(&total);
+	results_set_u64(&total, "ports", runner->njobs);
+	results_set_u64(&total, "failed", failed);
+	results_set_u64(&total, "tx_bytes", tx);
+	results_set_u64(&total, "rx_bytes", rx);
+	results_set_u64(&total, "errors", errors);
+	results_set_u64(&total, "elapsed_ns", wall_ns);
+	results_set_double(&total, "throughput_Bps", wall_ns ?
+		(double)(tx + rx) * NSEC_PER_SEC / wall_ns : 0);
+	results_emit(name, "total", failed ? -EIO : 0, &total);
+}
+
+/* Runs the jobs, whose argv is already set up, and reports the results */
+static int runner_exec(struct cmd *cmd, struct runner *runner, int nworkers)
+{
+	struct runner_job *job;
+	pthread_t *workers;
+	uint64_t start;
+	int i, ret = 0;
+
+	workers = (pthread_t *)calloc(nworkers, sizeof(pthread_t));
+	if (!workers)
+		return -ENOMEM;
+
+	/* getopt is not thread safe, so all instances are set up here */
+	for (i = 0; i < runner->njobs; i++) {
+		job = &runner->jobs[i];
+		job->cmd = *cmd;
+		job->cmd.priv = NULL;
+		job->cpu = runner_opts.ncpus ?
+			runner_opts.cpus[i % runner_opts.ncpus] : -1;
+
+		job->ret = init_cmd(&job->cmd, job->argc, job->argv);
+		job->initialized = !job->ret;
+	}
+
+	start = now_ns();
+
+	for (i = 0; i < nworkers; i++)
+		if (pthread_create(&workers[i], NULL, runner_worker, runner))
+			break;
+	nworkers = i;
+
+	/* Without any worker, run the ports from this thread */
+	if (!nworkers)
+		runner_worker(runner);
+
+	for (i = 0; i < nworkers; i++)
+		pthread_join(workers[i], NULL);
+
+	runner_report(runner, cmd->name, now_ns() - start);
+
+	for (i = 0; i < runner->njobs && !ret; i++)
+		ret = runner->jobs[i].ret;
+
+	free(workers);
+	return ret;
+}
+
+static void runner_free(struct runner *runner)
+{
+	int i;
+
+	for (i = 0; i < runner->njobs; i++)
+		free(runner->jobs[i].argv);
+	free(runner->jobs);
+}
+
+int run_multiport(struct cmd *cmd, int argc, char *argv[], char **ports,
+		int nports)
+{
+	struct runner runner;
+	struct runner_job *job;
+	int i, nworkers, ret = 0;
+
+	memset(&runner, 0, sizeof(runner));
+	runner.njobs = nports;
+	runner.jobs = (struct runner_job *)calloc(nports, sizeof(*job));
+	if (!runner.jobs)
+		return -ENOMEM;
+
+	for (i = 0; i < nports; i++) {
+		job = &runner.jobs[i];
+		job->port = ports[i];
+		job->argc = argc;
+		job->argv = (char **)calloc(argc + 1, sizeof(char *));
+		if (!job->argv) {
+			ret = -ENOMEM;
+			goto e_exit;
+		}
+		memcpy(job->argv, argv, argc * sizeof(char *));
+		job->argv[argc - 1] = ports[i];
+	}
+
+	nworkers = runner_opts.jobs > 0 && runner_opts.jobs < nports ?
+		runner_opts.jobs : nports;
+
+	ret = runner_exec(cmd, &runner, nworkers);
+
+e_exit:
+	runner_free(&runner);
+	return ret;
+}
+
+int run_loopback(struct cmd *cmd, int argc, char *argv[])
+{
+	static char *ends[] = {
+		TRANSPORT_PTY_PREFIX "1",
+		TRANSPORT_PTY_PREFIX "0",
+	};
+	struct runner runner;
+	struct runner_job *job;
+	int i, n, ret = 0;
+
+	if (!cmd->peer_opt) {
+		fprintf(stderr, "%s does not support loopback runs\n",
+			cmd->name);
+		return -EINVAL;
+	}
+
+	memset(&runner, 0, sizeof(runner));
+	runner.njobs = 2;
+	runner.jobs = (struct runner_job *)calloc(2, sizeof(*job));
+	if (!runner.jobs)
+		return -ENOMEM;
+
+	/*
+	 * The peer is set up first, the command line is used for the other
+	 * end. Both run concurrently whatever --jobs says.
+	 */
+	for (i = 0; i < 2; i++) {
+		job = &runner.jobs[i];
+		job->port = ends[i];
+		job->argv = (char **)calloc(argc + 3, sizeof(char *));
+		if (!job->argv) {
+			ret = -ENOMEM;
+			goto e_exit;
+		}
+
+		n = 0;
+		job->argv[n++] = argv[0];
+		if (i == 0)
+			job->argv[n++] = (char *)cmd->peer_opt;
+		memcpy(&job->argv[n], &argv[1], (argc - 1) * sizeof(char *));
+		n += argc - 1;
+		job->argv[n++] = ends[i];
+		job->argc = n;
+	}
+
+	ret = runner_exec(cmd, &runner, runner.njobs);
+
+e_exit:
+	runner_free(&runner);
+	return ret;
+}
@@ -0,0 +1,57 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include "cmd.h"
+
+struct runner_opts {
+	int jobs;	/* worker threads, 0 means one per port */
+	int *cpus;	/* CPUs the ports are pinned to, round robin */
+	int ncpus;
+};
+
+extern struct runner_opts runner_opts;
+
+int parse_cpu_list(const char *list, int **cpus, int *ncpus);
+
+/* Expands a comma separated list of devices and glob patterns */
+int expand_ports(const char *spec, char ***ports, int *nports);
+
+void free_ports(char **ports, int nports);
+
+/*
+ * Runs one instance of cmd per port. Every instance gets argv with the
+ * last argument replaced by its port.
+ */
+int run_multiport(struct cmd *cmd, int argc, char *argv[], char **ports,
+		int nports);
+
+/*
+ * Runs both ends of cmd over the loopback pair, the peer with the
+ * command's peer_opt added. The device is not part of argv.
+ */
+int run_loopback(struct cmd *cmd, int argc, char *argv[]);
+
+#endif /* RUNNER_H */
@@ -0,0 +1,316 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmd.h"
+#include "timeutil.h"
+
+const char script_help[] = "Usage:\n"
+	"\tuart_test script [options] <planFile>\n"
+	"Runs the commands of a test plan in one process, one step per line\n"
+	"as they would be given on the command line, '#' starts a comment.\n"
+	"A device is opened and set up with the termios profile once, the\n"
+	"settings a step leaves on it carry over to the next one.\n"
+	"Options:\n"
+	"\t-k, --keep-going\trun the remaining steps after a failure\n";
+
+#define SCRIPT_SEPARATORS	" \t\r\n"
+
+struct script_step {
+	int line;
+	int argc;
+	char **argv;
+	/* The tokens of argv point into buf, text is the line as written */
+	char *buf;
+	char *text;
+	int status;
+	uint64_t ns;
+	int done;
+};
+
+struct script_data {
+	const char *path;
+	int keep_going;
+	struct script_step *steps;
+	int nsteps;
+};
+
+static int script_add_step(struct script_data *pdata, char *line, int lineno)
+{
+	struct script_step *steps, *step;
+	char *hash, *tok, *save;
+	int max;
+
+	hash = strchr(line, '#');
+	if (hash)
+		*hash = '\0';
+
+	line += strspn(line, SCRIPT_SEPARATORS);
+	if (*line == '\0')
+		return 0;
+
+	steps = (struct script_step *)realloc(pdata->steps,
+		(pdata->nsteps + 1) * sizeof(*step));
+	if (!steps)
+		return -ENOMEM;
+	pdata->steps = steps;
+
+	step = &steps[pdata->nsteps];
+	memset(step, 0, sizeof(*step));
+	step->line = lineno;
+	step->text = strdup(line);
+	step->buf = strdup(line);
+	if (!step->text || !step->buf)
+		goto e_nomem;
+
+	for (max = strlen(step->text); max > 0 &&
+			strchr(SCRIPT_SEPARATORS, step->text[max - 1]); max--)
+		step->text[max - 1] = '\0';
+
+	/* There are never more tokens than half the characters, rounded up */
+	max = strlen(step->buf) / 2 + 2;
+	step->argv = (char **)calloc(max, sizeof(char *));
+	if (!step->argv)
+		goto e_nomem;
+
+	for (tok = strtok_r(step->buf, SCRIPT_SEPARATORS, &save); tok;
+			tok = strtok_r(NULL, SCRIPT_SEPARATORS, &save))
+		step->argv[step->argc++] = tok;
+
+	pdata->nsteps++;
+
+	if (!find_cmd(step->argv[0]) || strcmp(step->argv[0], "script") == 0) {
+		fprintf(stderr, "script: %s:%d: invalid command %s\n",
+			pdata->path, lineno, step->argv[0]);
+		return -EINVAL;
+	}
+
+	return 0;
+
+e_nomem:
+	free(step->argv);
+	free(step->buf);
+	free(step->text);
+	return -ENOMEM;
+}
+
+static int script_load(struct script_data *pdata)
+{
+	char *line = NULL;
+	size_t size = 0;
+	int lineno = 0, ret = 0;
+	FILE *f;
+
+	f = fopen(pdata->path, "r");
+	if (!f) {
+		ret = -errno;
+		fprintf(stderr, "script: Unable to open %s\n", pdata->path);
+		return ret;
+	}
+
+	while (getline(&line, &size, f) != -1) {
+		ret = script_add_step(pdata, line, ++lineno);
+		if (ret)
+			goto e_exit;
+	}
+
+	if (ferror(f)) {
+		ret = -EIO;
+		goto e_exit;
+	}
+
+	if (!pdata->nsteps) {
+		fprintf(stderr, "script: %s has no steps\n", pdata->path);
+		ret = -EINVAL;
+	}
+
+e_exit:
+	free(line);
+	fclose(f);
+	return ret;
+}
+
+static void script_free(struct script_data *pdata)
+{
+	int i;
+
+	for (i = 0; i < pdata->nsteps; i++) {
+		free(pdata->steps[i].argv);
+		free(pdata->steps[i].buf);
+		free(pdata->steps[i].text);
+	}
+	free(pdata->steps);
+	free(pdata);
+}
+
+static int script_init(struct cmd *cmd, int argc, char *argv[])
+{
+	struct script_data *pdata;
+	int c, ret;
+
+	static struct option long_options[] = {
+		{"keep-going", no_argument, 0, 'k'},
+		{0, 0, 0, 0}
+	};
+
+	pdata = (struct script_data *)calloc(1, sizeof(*pdata));
+	if (!pdata)
+		return -ENOMEM;
+
+	while (1) {
+		int option_index = 0;
+
+		c = getopt_long(argc, argv, "k", long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'k':
+			pdata->keep_going = 1;
+			break;
+		default:
+			fprintf(stderr, "script: Invalid parameters\n");
+			ret = -EINVAL;
+			goto e_exit;
+		}
+	}
+
+	if (optind != argc - 1) {
+		fprintf(stderr, "script: Invalid parameters\n");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	pdata->path = argv[optind];
+
+	ret = script_load(pdata);
+	if (ret)
+		goto e_exit;
+
+	cmd->priv = pdata;
+
+	return 0;
+
+e_exit:
+	script_free(pdata);
+	return ret;
+}
+
+static void script_print(struct script_data *pdata, uint64_t total_ns)
+{
+	struct script_step *step;
+	int i;
+
+	printf("\n%4s %5s %8s %12s  %s\n", "Step", "Line", "Status",
+		"Time (ms)", "Command");
+	for (i = 0; i < pdata->nsteps; i++) {
+		step = &pdata->steps[i];
+		if (step->done)
+			printf("%4d %5d %8d %12.3f  %s\n", i + 1, step->line,
+				step->status, (double)step->ns / NSEC_PER_MSEC,
+				step->text);
+		else
+			printf("%4d %5d %8s %12s  %s\n", i + 1, step->line,
+				"skipped", "-", step->text);
+	}
+	printf("Total %.3f ms\n", (double)total_ns / NSEC_PER_MSEC);
+}
+
+static int script_exec(struct cmd *cmd)
+{
+	struct script_data *pdata = (struct script_data *)cmd->priv;
+	struct script_step *step;
+	struct results step_results;
+	uint64_t start, total_ns = 0;
+	int i, failed = 0, ret = 0;
+
+	/* The summary comes first in the record, it is filled in at the end */
+	results_set_u64(&cmd->results, "steps", pdata->nsteps);
+	results_set_u64(&cmd->results, "failed", 0);
+	results_set_u64(&cmd->results, "total_ns", 0);
+
+	cmd_hold_ports();
+
+	for (i = 0; i < pdata->nsteps; i++) {
+		step = &pdata->steps[i];
+
+		printf("==> [%d/%d] %s\n", i + 1, pdata->nsteps, step->text);
+		fflush(stdout);
+
+		start = now_ns();
+		step->status = run_cmd(step->argc, step->argv);
+		step->ns = now_ns() - start;
+		step->done = 1;
+		total_ns += step->ns;
+
+		/* One record per step, however long the plan */
+		results_clear(&step_results);
+		results_set_u64(&step_results, "step", i + 1);
+		results_set_u64(&step_results, "line", step->line);
+		results_set_u64(&step_results, "step_ns", step->ns);
+		results_emit(cmd->name, pdata->path, step->status,
+			&step_results);
+
+		if (step->status) {
+			failed++;
+			if (!ret)
+				ret = step->status;
+			if (!pdata->keep_going)
+				break;
+		}
+	}
+
+	cmd_release_ports();
+
+	script_print(pdata, total_ns);
+
+	results_set_u64(&cmd->results, "failed", failed);
+	results_set_u64(&cmd->results, "total_ns", total_ns);
+
+	return ret;
+}
+
+static int script_cleanup(struct cmd *cmd)
+{
+	script_free((struct script_data *)cmd->priv);
+	cmd->priv = NULL;
+
+	return 0;
+}
+
+REGISTER_CMD(
+	script,
+	"runs the steps of a test plan over shared port handles",
+	script_help,
+	script_init,
+	script_exec,
+	script_cleanup,
+	.flags = CMD_NOPORT
+);
@@ -24,6 +24,8 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,13 +37,28 @@
 #include <sys/types.h>
 
 #include "cmd.h"
+#include "histogram.h"
+#include "timeutil.h"
 
 const char sendbreak_help[] = "Usage:\n"
-	"\tuart_test sendbreak [options] <ttyDevice>\n";
+	"\tuart_test sendbreak [options] <ttyDevice>\n"
+	"Options:\n"
+	"\t-d, --duration <n>\ttcsendbreak duration, driver specific\n"
+	"\t-n, --count <n>\t\tsend a train of <n> breaks with TIOCSBRK and\n"
+	"\t\t\t\tTIOCCBRK, timed on absolute deadlines\n"
+	"\t-w, --width <usec>\tbreak width in a train (default 10000)\n"
+	"\t-g, --gap <usec>\tidle time between breaks in a train\n"
+	"\t\t\t\t(default 10000)\n";
+
+#define SENDBREAK_WIDTH_US	10000
+#define SENDBREAK_GAP_US	10000
 
 struct sendbreak_data {
 	int fd;
 	int duration;
+	int count;
+	int width_us;
+	int gap_us;
 };
 
 static int sendbreak_init(struct cmd *cmd, int argc, char *argv[])
@@ -51,6 +68,9 @@ static int sendbreak_init(struct cmd *cmd, int argc, char *argv[])
 	struct sendbreak_data *pdata;
 	static struct option long_options[] = {
 		{"duration", optional_argument, 0, 'd'},
+		{"count", required_argument, 0, 'n'},
+		{"width", required_argument, 0, 'w'},
+		{"gap", required_argument, 0, 'g'},
 		{0, 0, 0, 0}
 	};
 
@@ -61,10 +81,14 @@ static int sendbreak_init(struct cmd *cmd, int argc, char *argv[])
 	if (!pdata)
 		return -ENOMEM;
 
+	pdata->width_us = SENDBREAK_WIDTH_US;
+	pdata->gap_us = SENDBREAK_GAP_US;
+
 	while (1) {
 		int option_index = 0;
 
-		c = getopt_long(argc, argv, "d:", long_options, &option_index);
+		c = getopt_long(argc, argv, "d:n:w:g:", long_options,
+				&option_index);
 		if (c == -1)
 			break;
 
@@ -72,18 +96,32 @@ static int sendbreak_init(struct cmd *cmd, int argc, char *argv[])
 		case 'd':
 			pdata->duration = atoi(optarg);
 			break;
+		case 'n':
+			pdata->count = atoi(optarg);
+			break;
+		case 'w':
+			pdata->width_us = atoi(optarg);
+			break;
+		case 'g':
+			pdata->gap_us = atoi(optarg);
+			break;
 		}
 	}
 
+	if (pdata->count < 0 || pdata->width_us <= 0 || pdata->gap_us < 0) {
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
 	if (optind != argc - 1) {
 		fprintf(stderr, "Please specify the tty device");
 		ret = -EINVAL;
 		goto e_exit;
 	}
 
-	pdata->fd = open(argv[optind], O_RDWR | O_NOCTTY);
+	pdata->fd = cmd_open_port(cmd, argv[optind], 0, 0);
 	if (pdata->fd < 0) {
-		ret = -ENOENT;
+		ret = pdata->fd;
 		goto e_exit;
 	}
 
@@ -96,6 +134,86 @@ e_exit:
 	return ret;
 }
 
+/*
+ * Every edge is scheduled on an absolute deadline, so the widths do not
+ * accumulate the latency of the ioctls and the wakeups.
+ */
+static int send_break_train(struct sendbreak_data *pdata,
+		struct results *results)
+{
+	struct histogram *width, *late;
+	uint64_t start, edge, set_at, clear_at, width_ns, period;
+	double error, sum = 0, sumsq = 0, mean, variance, jitter;
+	int i, ret = 0;
+
+	width = (struct histogram *)malloc(sizeof(*width));
+	late = (struct histogram *)malloc(sizeof(*late));
+	if (!width || !late) {
+		ret = -ENOMEM;
+		goto e_exit;
+	}
+	hist_init(width);
+	hist_init(late);
+
+	width_ns = pdata->width_us * NSEC_PER_USEC;
+	period = width_ns + pdata->gap_us * NSEC_PER_USEC;
+	start = now_ns() + NSEC_PER_MSEC;
+
+	for (i = 0; i < pdata->count; i++) {
+		edge = start + i * period;
+
+		sleep_until_ns(edge);
+		if (ioctl(pdata->fd, TIOCSBRK) < 0) {
+			ret = -errno;
+			break;
+		}
+		set_at = now_ns();
+
+		sleep_until_ns(edge + width_ns);
+		if (ioctl(pdata->fd, TIOCCBRK) < 0) {
+			ret = -errno;
+			break;
+		}
+		clear_at = now_ns();
+
+		hist_record(late, set_at - edge);
+		hist_record(late, clear_at - (edge + width_ns));
+		hist_record(width, clear_at - set_at);
+
+		error = (double)(clear_at - set_at) - width_ns;
+		sum += error;
+		sumsq += error * error;
+	}
+
+	/* Never leave the line in break */
+	if (ret)
+		ioctl(pdata->fd, TIOCCBRK);
+
+	if (width->total) {
+		mean = sum / width->total;
+		/* Rounding can take the variance of equal errors below 0 */
+		variance = sumsq / width->total - mean * mean;
+		jitter = sqrt(variance > 0 ? variance : 0);
+
+		hist_print(width, "Width", stdout);
+		hist_print(late, "Edge lateness", stdout);
+		printf("Width error: mean %+.1f usec, jitter %.1f usec "
+			"(stddev)\n", mean / NSEC_PER_USEC,
+			jitter / NSEC_PER_USEC);
+
+		results_set_u64(results, "breaks", width->total);
+		results_set_hist(results, "width", width);
+		results_set_hist(results, "edge_late", late);
+		results_set_double(results, "width_error_ns", mean);
+		results_set_double(results, "width_jitter_ns", jitter);
+	}
+
+e_exit:
+	free(width);
+	free(late);
+	return ret;
+}
+
 static int sendbreak_exec(struct cmd *cmd)
 {
 	struct sendbreak_data *pdata;
@@ -105,6 +223,9 @@ static int sendbreak_exec(struct cmd *cmd)
 
 	pdata = (struct sendbreak_data *)cmd->priv;
 
+	if (pdata->count)
+		return send_break_train(pdata, &cmd->results);
+
 	if (tcsendbreak(pdata->fd, pdata->duration))
 		return -errno;
 
@@ -113,17 +234,11 @@ static int sendbreak_exec(struct cmd *cmd)
 
 static int sendbreak_cleanup(struct cmd *cmd)
 {
-	struct sendbreak_data *pdata;
-
 	if (!cmd->priv)
 		return -EINVAL;
 
-	pdata = (struct sendbreak_data *)cmd->priv;
-
-	if (pdata->fd)
-		close(pdata->fd);
-
 	free(cmd->priv);
+	cmd->priv = NULL;
 
 	return 0;
 }
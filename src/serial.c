@@ -0,0 +1,123 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+#include <linux/serial.h>
+
+#include "serial.h"
+
+int serial_get_baudrate(int fd)
+{
+	struct termios2 tio;
+
+	if (ioctl(fd, TCGETS2, &tio))
+		return -errno;
+
+	return tio.c_ospeed;
+}
+
+int serial_bits_per_char(int fd)
+{
+	struct termios2 tio;
+	int bits;
+
+	if (ioctl(fd, TCGETS2, &tio))
+		return 10;
+
+	switch (tio.c_cflag & CSIZE) {
+	case CS5:
+		bits = 5;
+		break;
+	case CS6:
+		bits = 6;
+		break;
+	case CS7:
+		bits = 7;
+		break;
+	default:
+		bits = 8;
+		break;
+	}
+
+	return 1 + bits + !!(tio.c_cflag & PARENB) +
+		((tio.c_cflag & CSTOPB) ? 2 : 1);
+}
+
+double serial_line_rate(int fd)
+{
+	int baudrate = serial_get_baudrate(fd);
+
+	if (baudrate <= 0)
+		return 0;
+
+	return (double)baudrate / serial_bits_per_char(fd);
+}
+
+int serial_get_counters(int fd, struct serial_counters *counters)
+{
+	struct serial_icounter_struct icount;
+
+	if (ioctl(fd, TIOCGICOUNT, &icount))
+		return -errno;
+
+	counters->rx = icount.rx;
+	counters->tx = icount.tx;
+	counters->frame = icount.frame;
+	counters->overrun = icount.overrun;
+	counters->parity = icount.parity;
+	counters->brk = icount.brk;
+	counters->buf_overrun = icount.buf_overrun;
+
+	return 0;
+}
+
+int serial_get_low_latency(int fd)
+{
+	struct serial_struct serial;
+
+	if (ioctl(fd, TIOCGSERIAL, &serial))
+		return -errno;
+
+	return !!(serial.flags & ASYNC_LOW_LATENCY);
+}
+
+int serial_set_low_latency(int fd, int enable)
+{
+	struct serial_struct serial;
+
+	if (ioctl(fd, TIOCGSERIAL, &serial))
+		return -errno;
+
+	if (enable)
+		serial.flags |= ASYNC_LOW_LATENCY;
+	else
+		serial.flags &= ~ASYNC_LOW_LATENCY;
+
+	if (ioctl(fd, TIOCSSERIAL, &serial))
+		return -errno;
+
+	return 0;
+}
@@ -0,0 +1,57 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+
+/* Subset of the TIOCGICOUNT counters, they wrap like the kernel's ints */
+struct serial_counters {
+	uint32_t rx;
+	uint32_t tx;
+	uint32_t frame;
+	uint32_t overrun;
+	uint32_t parity;
+	uint32_t brk;
+	uint32_t buf_overrun;
+};
+
+/* Configured baud rate of the port or a negative error code */
+int serial_get_baudrate(int fd);
+
+/* Bits on the wire per character: start, data, parity and stop bits */
+int serial_bits_per_char(int fd);
+
+/* Line rate in bytes per second, or 0 if it cannot be determined */
+double serial_line_rate(int fd);
+
+/* Fails with -ENOTTY or -EINVAL on drivers without interrupt counters */
+int serial_get_counters(int fd, struct serial_counters *counters);
+
+/* ASYNC_LOW_LATENCY through TIOCGSERIAL: 0 or 1, or a negative error */
+int serial_get_low_latency(int fd);
+
+int serial_set_low_latency(int fd, int enable);
+
+#endif /* SERIAL_H */
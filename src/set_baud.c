@@ -22,14 +22,12 @@
  * SOFTWARE.
  */
 #include <errno.h>
-#include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/uio.h>
-#include <asm/termios.h>
 #include <unistd.h>
 
 #include "cmd.h"
@@ -96,14 +94,12 @@ static int set_baud_init(struct cmd *cmd, int argc, char *argv[])
 		goto e_exit;
 	}
 
-	pdata->fd = open(argv[optind], O_RDWR | O_NOCTTY);
+	pdata->fd = cmd_open_port(cmd, argv[optind], PORT_FLUSH, 0);
 	if (pdata->fd < 0) {
-		ret = -ENOENT;
+		ret = pdata->fd;
 		goto e_exit;
 	}
 
-	tcflush(pdata->fd, TCIFLUSH);
-
 	cmd->priv = (void *) pdata;
 
 	return 0;
@@ -118,7 +114,6 @@ static int set_baud_exec(struct cmd *cmd)
 	struct set_baud_data *pdata = (struct set_baud_data *)cmd->priv;
 	char *pbuffer;
 	ssize_t count;
-	struct termios2 tio;
 	int ret = 0;
 
 	if (!pdata)
@@ -128,18 +123,11 @@ static int set_baud_exec(struct cmd *cmd)
 	if (!pbuffer)
 		return -EINVAL;
 
-	ret = ioctl(pdata->fd, TCGETS2, &tio);
+	ret = port_set_baudrate(&cmd->port, pdata->baudrate);
 	if (ret != 0)
 		goto e_exit;
 
-	tio.c_cflag &= ~CBAUD;
-	tio.c_cflag |= BOTHER;
-	tio.c_ispeed = pdata->baudrate;
-	tio.c_ospeed = pdata->baudrate;
-
-	ret = ioctl(pdata->fd, TCSETS2, &tio);
-	if (ret != 0)
-		goto e_exit;
+	results_set_u64(&cmd->results, "baudrate", pdata->baudrate);
 
 	if (pdata->receiver) {
 		count = read(pdata->fd, pbuffer, strlen(test_str));
@@ -148,6 +136,8 @@ static int set_baud_exec(struct cmd *cmd)
 			goto e_exit;
 		}
 
+		results_set_u64(&cmd->results, "rx_bytes", count);
+
 		if (strcmp(pbuffer, test_str) != 0) {
 			ret = -EINVAL;
 			goto e_exit;
@@ -159,6 +149,8 @@ static int set_baud_exec(struct cmd *cmd)
 			ret = -errno;
 			goto e_exit;
 		}
+
+		results_set_u64(&cmd->results, "tx_bytes", count);
 	}
 
 e_exit:
@@ -184,5 +176,7 @@ REGISTER_CMD(
 	set_baud_help,
 	set_baud_init,
 	set_baud_exec,
-	set_baud_cleanup
+	set_baud_cleanup,
+	.flags = CMD_MULTIPORT,
+	.peer_opt = "-r"
 );
@@ -0,0 +1,104 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spsc.h"
+
+int spsc_init(struct spsc_ring *ring, size_t size)
+{
+	memset(ring, 0, sizeof(*ring));
+
+	ring->size = 1;
+	while (ring->size < size)
+		ring->size <<= 1;
+
+	ring->buf = (char *)malloc(ring->size);
+	if (!ring->buf)
+		return -ENOMEM;
+
+	return 0;
+}
+
+void spsc_free(struct spsc_ring *ring)
+{
+	free(ring->buf);
+	ring->buf = NULL;
+}
+
+size_t spsc_write_space(struct spsc_ring *ring, char **ptr)
+{
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	size_t idx = ring->head & (ring->size - 1);
+	size_t len = ring->size - (ring->head - tail);
+
+	if (len > ring->size - idx)
+		len = ring->size - idx;
+
+	*ptr = ring->buf + idx;
+	return len;
+}
+
+void spsc_commit(struct spsc_ring *ring, size_t len)
+{
+	uint64_t head = ring->head + len;
+	uint64_t fill = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if (fill > ring->peak)
+		ring->peak = fill;
+
+	__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+}
+
+size_t spsc_read_space(struct spsc_ring *ring, const char **ptr)
+{
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	size_t idx = ring->tail & (ring->size - 1);
+	size_t len = head - ring->tail;
+
+	if (len > ring->size - idx)
+		len = ring->size - idx;
+
+	*ptr = ring->buf + idx;
+	return len;
+}
+
+void spsc_release(struct spsc_ring *ring, size_t len)
+{
+	__atomic_store_n(&ring->tail, ring->tail + len, __ATOMIC_RELEASE);
+}
+
+void spsc_close(struct spsc_ring *ring)
+{
+	__atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+}
+
+int spsc_done(struct spsc_ring *ring)
+{
+	/* Everything committed before the close is visible after it */
+	return __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) &&
+		__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail;
+}
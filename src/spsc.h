@@ -0,0 +1,64 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Lock-free byte ring between one producer and one consumer thread. Both
+ * sides work on contiguous regions in place: they ask for the space they
+ * may use, fill or consume some of it, then publish what they did.
+ */
+struct spsc_ring {
+	char *buf;
+	size_t size;		/* a power of two */
+	uint64_t head;		/* bytes produced, written by the producer */
+	uint64_t tail;		/* bytes consumed, written by the consumer */
+	int closed;		/* no more data will be produced */
+	uint64_t peak;		/* highest fill seen by the producer */
+};
+
+/* size is rounded up to a power of two */
+int spsc_init(struct spsc_ring *ring, size_t size);
+
+void spsc_free(struct spsc_ring *ring);
+
+/* Contiguous free space at *ptr, 0 when the ring is full */
+size_t spsc_write_space(struct spsc_ring *ring, char **ptr);
+
+void spsc_commit(struct spsc_ring *ring, size_t len);
+
+/* Contiguous data at *ptr, 0 when the ring is empty */
+size_t spsc_read_space(struct spsc_ring *ring, const char **ptr);
+
+void spsc_release(struct spsc_ring *ring, size_t len);
+
+void spsc_close(struct spsc_ring *ring);
+
+/* True once closed and every byte produced has been consumed */
+int spsc_done(struct spsc_ring *ring);
+
+#endif /* SPSC_H */
@@ -0,0 +1,365 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "timeutil.h"
+#include "trace.h"
+
+/* Records per thread, a power of two */
+#define TRACE_RING_RECORDS	16384
+#define TRACE_DRAIN_MS		2
+/* Rings alive at once, the calls of threads beyond that are dropped */
+#define TRACE_MAX_RINGS		64
+
+/* Single producer, the traced thread, and single consumer, the drainer */
+struct trace_ring {
+	struct trace_record *records;
+	uint64_t head;
+	uint64_t tail;
+	uint64_t dropped;
+	uint16_t thread;
+	struct trace_ring *next;
+	struct trace_ring *next_free;
+};
+
+static int trace_enabled;
+static int trace_stopping;
+static FILE *trace_file;
+static char *trace_path;
+static pthread_t trace_drainer;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring *trace_rings;
+static int trace_nrings;
+/* Rings of exited threads, handed to the next new thread */
+static struct trace_ring *trace_free;
+static pthread_key_t trace_key;
+static uint64_t trace_unringed;
+static uint16_t trace_threads;
+static uint64_t trace_written;
+static __thread struct trace_ring *trace_ring;
+
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+int __real_ioctl(int fd, unsigned long request, void *argp);
+
+/* Thread exit: the drainer keeps emptying the ring until it is reused */
+static void trace_put_ring(void *arg)
+{
+	struct trace_ring *ring = (struct trace_ring *)arg;
+
+	pthread_mutex_lock(&trace_lock);
+	if (!trace_stopping) {
+		ring->next_free = trace_free;
+		trace_free = ring;
+	}
+	pthread_mutex_unlock(&trace_lock);
+}
+
+static struct trace_ring *trace_new_ring(void)
+{
+	struct trace_ring *ring;
+
+	ring = (struct trace_ring *)calloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	ring->records = (struct trace_record *)malloc(TRACE_RING_RECORDS *
+		sizeof(struct trace_record));
+	if (!ring->records) {
+		free(ring);
+		return NULL;
+	}
+
+	/* Fault the pages in now rather than in the middle of a test */
+	memset(ring->records, 0, TRACE_RING_RECORDS *
+		sizeof(struct trace_record));
+
+	ring->next = trace_rings;
+	__atomic_store_n(&trace_rings, ring, __ATOMIC_RELEASE);
+	trace_nrings++;
+
+	return ring;
+}
+
+static struct trace_ring *trace_get_ring(void)
+{
+	struct trace_ring *ring = trace_ring;
+
+	if (ring)
+		return ring;
+
+	pthread_mutex_lock(&trace_lock);
+	ring = trace_free;
+	if (ring)
+		trace_free = ring->next_free;
+	else if (trace_nrings < TRACE_MAX_RINGS)
+		ring = trace_new_ring();
+	if (ring)
+		ring->thread = trace_threads++;
+	pthread_mutex_unlock(&trace_lock);
+
+	if (!ring)
+		return NULL;
+
+	pthread_setspecific(trace_key, ring);
+	trace_ring = ring;
+	return ring;
+}
+
+static void trace_add(int op, int fd, uint64_t arg, int64_t result,
+		uint64_t start)
+{
+	uint64_t end = now_ns(), head;
+	struct trace_ring *ring = trace_get_ring();
+	struct trace_record *rec;
+
+	if (!ring) {
+		__atomic_add_fetch(&trace_unringed, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	head = ring->head;
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) ==
+			TRACE_RING_RECORDS) {
+		ring->dropped++;
+		return;
+	}
+
+	rec = &ring->records[head & (TRACE_RING_RECORDS - 1)];
+	rec->start_ns = start;
+	rec->latency_ns = end - start > UINT32_MAX ? UINT32_MAX : end - start;
+	rec->fd = fd;
+	rec->arg = arg;
+	rec->result = result;
+	rec->op = op;
+	rec->thread = ring->thread;
+	rec->reserved = 0;
+
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t count)
+{
+	uint64_t start;
+	ssize_t ret;
+	int err;
+
+	if (!__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED))
+		return __real_read(fd, buf, count);
+
+	start = now_ns();
+	ret = __real_read(fd, buf, count);
+	err = errno;
+	trace_add(TRACE_READ, fd, count, ret < 0 ? -err : ret, start);
+	errno = err;
+
+	return ret;
+}
+
+ssize_t __wrap_write(int fd, const void *buf, size_t count)
+{
+	uint64_t start;
+	ssize_t ret;
+	int err;
+
+	if (!__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED))
+		return __real_write(fd, buf, count);
+
+	start = now_ns();
+	ret = __real_write(fd, buf, count);
+	err = errno;
+	trace_add(TRACE_WRITE, fd, count, ret < 0 ? -err : ret, start);
+	errno = err;
+
+	return ret;
+}
+
+/* The third argument is either absent, an int or a pointer */
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+	uint64_t start;
+	va_list ap;
+	void *argp;
+	int ret, err;
+
+	va_start(ap, request);
+	argp = va_arg(ap, void *);
+	va_end(ap);
+
+	if (!__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED))
+		return __real_ioctl(fd, request, argp);
+
+	start = now_ns();
+	ret = __real_ioctl(fd, request, argp);
+	err = errno;
+	trace_add(TRACE_IOCTL, fd, request, ret < 0 ? -err : ret, start);
+	errno = err;
+
+	return ret;
+}
+
+/* stdio writes through the C library's own write, which is not traced */
+static void trace_drain(void)
+{
+	struct trace_ring *ring;
+	uint64_t head, tail, idx, n;
+
+	for (ring = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE); ring;
+			ring = ring->next) {
+		tail = ring->tail;
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+		while (tail != head) {
+			idx = tail & (TRACE_RING_RECORDS - 1);
+			n = head - tail;
+			if (n > TRACE_RING_RECORDS - idx)
+				n = TRACE_RING_RECORDS - idx;
+
+			trace_written += fwrite(&ring->records[idx],
+				sizeof(struct trace_record), n, trace_file);
+			tail += n;
+		}
+
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+}
+
+static void *trace_drain_func(void *arg)
+{
+	(void)arg;
+
+	while (!__atomic_load_n(&trace_stopping, __ATOMIC_ACQUIRE)) {
+		trace_drain();
+		sleep_until_ns(now_ns() + TRACE_DRAIN_MS * NSEC_PER_MSEC);
+	}
+
+	return NULL;
+}
+
+int trace_start(const char *path)
+{
+	struct trace_header header = {
+		.magic = TRACE_MAGIC,
+		.version = TRACE_VERSION,
+		.record_size = sizeof(struct trace_record),
+	};
+	int ret;
+
+	trace_file = fopen(path, "wb");
+	if (!trace_file)
+		return -errno;
+
+	trace_path = strdup(path);
+	if (!trace_path) {
+		ret = -ENOMEM;
+		goto e_close;
+	}
+
+	if (fwrite(&header, sizeof(header), 1, trace_file) != 1) {
+		ret = -EIO;
+		goto e_close;
+	}
+
+	ret = -pthread_key_create(&trace_key, trace_put_ring);
+	if (ret)
+		goto e_close;
+
+	ret = -pthread_create(&trace_drainer, NULL, trace_drain_func, NULL);
+	if (ret) {
+		pthread_key_delete(trace_key);
+		goto e_close;
+	}
+
+	__atomic_store_n(&trace_enabled, 1, __ATOMIC_RELEASE);
+
+	return 0;
+
+e_close:
+	free(trace_path);
+	trace_path = NULL;
+	fclose(trace_file);
+	trace_file = NULL;
+	return ret;
+}
+
+void trace_stop(void)
+{
+	struct trace_header header = {
+		.magic = TRACE_MAGIC,
+		.version = TRACE_VERSION,
+		.record_size = sizeof(struct trace_record),
+	};
+	struct trace_ring *ring, *next;
+	int ret = 0;
+
+	if (!trace_file)
+		return;
+
+	__atomic_store_n(&trace_enabled, 0, __ATOMIC_RELEASE);
+	pthread_mutex_lock(&trace_lock);
+	__atomic_store_n(&trace_stopping, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&trace_lock);
+	pthread_join(trace_drainer, NULL);
+	trace_drain();
+
+	for (ring = trace_rings; ring; ring = next) {
+		next = ring->next;
+		header.dropped += ring->dropped;
+		free(ring->records);
+		free(ring);
+	}
+	trace_rings = NULL;
+	trace_free = NULL;
+	trace_nrings = 0;
+	trace_ring = NULL;
+	pthread_key_delete(trace_key);
+	header.dropped += trace_unringed;
+	header.records = trace_written;
+
+	if (fseek(trace_file, 0, SEEK_SET) ||
+			fwrite(&header, sizeof(header), 1, trace_file) != 1)
+		ret = -EIO;
+	if (fclose(trace_file))
+		ret = -EIO;
+
+	if (ret)
+		fprintf(stderr, "Failed to write the trace to %s\n",
+			trace_path);
+	else
+		fprintf(stderr, "Traced %" PRIu64 " calls of %u threads to %s, "
+			"%" PRIu64 " dropped\n", header.records, trace_threads,
+			trace_path, header.dropped);
+
+	trace_file = NULL;
+	free(trace_path);
+	trace_path = NULL;
+}
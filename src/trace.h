@@ -0,0 +1,83 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <errno.h>
+#include <stdint.h>
+
+/*
+ * Every read(2), write(2) and ioctl(2) made by the tests can be recorded
+ * in a preallocated ring of the calling thread. A drainer thread empties
+ * the rings into a file: a struct trace_header followed by the records.
+ * The calls are intercepted at link time, see CMakeLists.txt.
+ */
+#define TRACE_MAGIC	0x52545455	/* "UTTR" */
+#define TRACE_VERSION	1
+
+enum {
+	TRACE_READ,
+	TRACE_WRITE,
+	TRACE_IOCTL,
+	TRACE_OPS
+};
+
+struct trace_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint64_t records;
+	uint64_t dropped;	/* lost to full rings */
+};
+
+struct trace_record {
+	uint64_t start_ns;	/* CLOCK_MONOTONIC */
+	uint32_t latency_ns;	/* saturates at UINT32_MAX */
+	int32_t fd;
+	uint64_t arg;		/* requested bytes or the ioctl request */
+	int64_t result;		/* return value, -errno on failure */
+	uint16_t op;
+	uint16_t thread;	/* in the order of their first traced call */
+	uint32_t reserved;
+};
+
+#ifdef HAVE_TRACE
+/* Starts tracing to path, 0 or a negative error code */
+int trace_start(const char *path);
+
+/* Drains the rings, completes the header and closes the file */
+void trace_stop(void);
+#else
+static inline int trace_start(const char *path)
+{
+	(void)path;
+	return -ENOTSUP;
+}
+
+static inline void trace_stop(void)
+{
+}
+#endif
+
+#endif /* TRACE_H */
@@ -0,0 +1,262 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmd.h"
+#include "histogram.h"
+#include "trace.h"
+
+const char trace_stats_help[] = "Usage:\n"
+	"\tuart_test trace_stats <traceFile>\n"
+	"Summarizes a file written with --trace: per thread and call, the\n"
+	"latency percentiles and how many bytes each read and write moved.\n";
+
+#define TRACE_STATS_BATCH	4096
+/* Sizes 0, 1, 2-3, 4-7, ... up to 2^31 and above */
+#define TRACE_SIZE_BUCKETS	33
+
+struct trace_stat {
+	uint64_t calls;
+	uint64_t errors;
+	uint64_t bytes;
+	uint64_t sizes[TRACE_SIZE_BUCKETS];
+	struct histogram latency;
+};
+
+struct trace_stats_data {
+	const char *path;
+	struct trace_stat *stats;	/* TRACE_OPS per thread */
+	int nthreads;
+};
+
+static const char *trace_op_names[TRACE_OPS] = { "read", "write", "ioctl" };
+
+static int trace_stats_init(struct cmd *cmd, int argc, char *argv[])
+{
+	struct trace_stats_data *pdata;
+
+	if (argc != 2) {
+		printf("trace_stats: Invalid parameters\n");
+		return -EINVAL;
+	}
+
+	pdata = (struct trace_stats_data *)calloc(1, sizeof(*pdata));
+	if (!pdata)
+		return -ENOMEM;
+
+	pdata->path = argv[1];
+	cmd->priv = pdata;
+
+	return 0;
+}
+
+static struct trace_stat *trace_stat_get(struct trace_stats_data *pdata,
+		int thread, int op)
+{
+	struct trace_stat *stats;
+	int i;
+
+	if (thread >= pdata->nthreads) {
+		stats = (struct trace_stat *)realloc(pdata->stats,
+			(thread + 1) * TRACE_OPS * sizeof(*stats));
+		if (!stats)
+			return NULL;
+
+		for (i = pdata->nthreads * TRACE_OPS;
+				i < (thread + 1) * TRACE_OPS; i++) {
+			memset(&stats[i], 0, sizeof(stats[i]));
+			hist_init(&stats[i].latency);
+		}
+
+		pdata->stats = stats;
+		pdata->nthreads = thread + 1;
+	}
+
+	return &pdata->stats[thread * TRACE_OPS + op];
+}
+
+static int size_bucket(int64_t size)
+{
+	int bucket = 0;
+
+	while (size > 0 && bucket < TRACE_SIZE_BUCKETS - 1) {
+		size >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+static int trace_stats_add(struct trace_stats_data *pdata,
+		const struct trace_record *rec)
+{
+	struct trace_stat *stat;
+
+	if (rec->op >= TRACE_OPS)
+		return -EINVAL;
+
+	stat = trace_stat_get(pdata, rec->thread, rec->op);
+	if (!stat)
+		return -ENOMEM;
+
+	stat->calls++;
+	hist_record(&stat->latency, rec->latency_ns);
+
+	if (rec->result < 0) {
+		stat->errors++;
+	} else if (rec->op != TRACE_IOCTL) {
+		stat->bytes += rec->result;
+		stat->sizes[size_bucket(rec->result)]++;
+	}
+
+	return 0;
+}
+
+static void trace_stat_print(int thread, int op, const struct trace_stat *stat)
+{
+	char name[32];
+	int i;
+
+	printf("\nThread %d %s: %" PRIu64 " calls, %" PRIu64 " errors",
+		thread, trace_op_names[op], stat->calls, stat->errors);
+	if (op != TRACE_IOCTL)
+		printf(", %" PRIu64 " bytes", stat->bytes);
+	printf("\n");
+
+	hist_print(&stat->latency, "Latency", stdout);
+
+	if (op == TRACE_IOCTL)
+		return;
+
+	printf("%12s %12s %7s\n", "Returned", "Calls", "%");
+	for (i = 0; i < TRACE_SIZE_BUCKETS; i++) {
+		if (!stat->sizes[i])
+			continue;
+
+		if (i < 2)
+			snprintf(name, sizeof(name), "%d", i);
+		else
+			snprintf(name, sizeof(name), "%llu-%llu",
+				1ULL << (i - 1), (1ULL << i) - 1);
+
+		printf("%12s %12" PRIu64 " %7.2f\n", name, stat->sizes[i],
+			100.0 * stat->sizes[i] / stat->calls);
+	}
+}
+
+static int trace_stats_exec(struct cmd *cmd)
+{
+	struct trace_stats_data *pdata = (struct trace_stats_data *)cmd->priv;
+	struct trace_header header;
+	struct trace_record *recs;
+	uint64_t records = 0;
+	size_t i, n;
+	int thread, op, ret = 0;
+	FILE *f;
+
+	f = fopen(pdata->path, "rb");
+	if (!f) {
+		fprintf(stderr, "trace_stats: Unable to open %s\n",
+			pdata->path);
+		return -errno;
+	}
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+			header.magic != TRACE_MAGIC ||
+			header.version != TRACE_VERSION ||
+			header.record_size != sizeof(struct trace_record)) {
+		fprintf(stderr, "trace_stats: %s is not a trace file\n",
+			pdata->path);
+		fclose(f);
+		return -EINVAL;
+	}
+
+	recs = (struct trace_record *)malloc(TRACE_STATS_BATCH *
+		sizeof(*recs));
+	if (!recs) {
+		fclose(f);
+		return -ENOMEM;
+	}
+
+	while ((n = fread(recs, sizeof(*recs), TRACE_STATS_BATCH, f)) > 0) {
+		for (i = 0; i < n && !ret; i++)
+			ret = trace_stats_add(pdata, &recs[i]);
+		if (ret)
+			goto e_exit;
+		records += n;
+	}
+
+	printf("%" PRIu64 " calls of %d threads, %" PRIu64 " dropped\n",
+		records, pdata->nthreads, header.dropped);
+	if (records != header.records)
+		printf("The trace is truncated, %" PRIu64 " calls expected\n",
+			header.records);
+
+	for (thread = 0; thread < pdata->nthreads; thread++)
+		for (op = 0; op < TRACE_OPS; op++)
+			if (pdata->stats[thread * TRACE_OPS + op].calls)
+				trace_stat_print(thread, op,
+					&pdata->stats[thread * TRACE_OPS + op]);
+
+	results_set_u64(&cmd->results, "records", records);
+	results_set_u64(&cmd->results, "dropped", header.dropped);
+	results_set_u64(&cmd->results, "threads", pdata->nthreads);
+
+e_exit:
+	if (ret == -EINVAL)
+		fprintf(stderr, "trace_stats: Invalid record in %s\n",
+			pdata->path);
+	free(recs);
+	fclose(f);
+	return ret;
+}
+
+static int trace_stats_cleanup(struct cmd *cmd)
+{
+	struct trace_stats_data *pdata = (struct trace_stats_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	free(pdata->stats);
+	free(pdata);
+	cmd->priv = NULL;
+
+	return 0;
+}
+
+REGISTER_CMD(
+	trace_stats,
+	"summarizes a system call trace written with --trace",
+	trace_stats_help,
+	trace_stats_init,
+	trace_stats_exec,
+	trace_stats_cleanup,
+	.flags = CMD_NOPORT
+);
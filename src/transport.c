@@ -0,0 +1,155 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "transport.h"
+
+/* Index 0 is the master, 1 the slave */
+static int loopback_fds[2] = { -1, -1 };
+static int loopback_ptn = -1;
+static dev_t loopback_rdev;
+
+static void transport_close(void)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (loopback_fds[i] >= 0)
+			close(loopback_fds[i]);
+		loopback_fds[i] = -1;
+	}
+}
+
+int transport_loopback(const char *kind)
+{
+	struct termios tio;
+	struct stat st;
+	int ret;
+
+	if (strcmp(kind, "pty") != 0)
+		return -EINVAL;
+
+	if (openpty(&loopback_fds[0], &loopback_fds[1], NULL, NULL, NULL))
+		return -errno;
+
+	/* Both ends share the slave settings, echo would loop data back */
+	if (tcgetattr(loopback_fds[1], &tio) ||
+			ioctl(loopback_fds[0], TIOCGPTN, &loopback_ptn) ||
+			fstat(loopback_fds[1], &st)) {
+		ret = -errno;
+		goto e_exit;
+	}
+
+	cfmakeraw(&tio);
+	if (tcsetattr(loopback_fds[1], TCSANOW, &tio)) {
+		ret = -errno;
+		goto e_exit;
+	}
+
+	loopback_rdev = st.st_rdev;
+	atexit(transport_close);
+
+	return 0;
+
+e_exit:
+	transport_close();
+	return ret;
+}
+
+int transport_loopback_enabled(void)
+{
+	return loopback_fds[0] >= 0;
+}
+
+int transport_open(const char *path, int flags)
+{
+	size_t len = strlen(TRANSPORT_PTY_PREFIX);
+	int idx;
+
+	if (strncmp(path, TRANSPORT_PTY_PREFIX, len) != 0)
+		return open(path, flags);
+
+	idx = path[len] - '0';
+	if ((idx != 0 && idx != 1) || path[len + 1] != '\0') {
+		errno = ENOENT;
+		return -1;
+	}
+
+	if (loopback_fds[idx] < 0) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	return fcntl(loopback_fds[idx], F_DUPFD_CLOEXEC, 0);
+}
+
+/* The loopback end on the other side of fd, or -1 for a real port */
+static int transport_peer(int fd)
+{
+	struct stat st;
+	int ptn;
+
+	if (!transport_loopback_enabled())
+		return -1;
+
+	if (ioctl(fd, TIOCGPTN, &ptn) == 0)
+		return ptn == loopback_ptn ? loopback_fds[1] : -1;
+
+	if (fstat(fd, &st) == 0 && S_ISCHR(st.st_mode) &&
+			st.st_rdev == loopback_rdev)
+		return loopback_fds[0];
+
+	return -1;
+}
+
+int transport_set_rts(int fd, int level)
+{
+	int status, peer;
+
+	peer = transport_peer(fd);
+	if (peer >= 0)
+		return tcflow(peer, level ? TCOON : TCOOFF) ? -errno : 0;
+
+	if (ioctl(fd, TIOCMGET, &status) == -1)
+		return -errno;
+
+	if (level)
+		status |= TIOCM_RTS;
+	else
+		status &= ~TIOCM_RTS;
+
+	if (ioctl(fd, TIOCMSET, &status) == -1)
+		return -errno;
+
+	return 0;
+}
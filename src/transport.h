@@ -0,0 +1,47 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+/*
+ * Devices named "pty:0" and "pty:1" refer to the two ends of the loopback
+ * pseudo-terminal pair set up by transport_loopback(). Every other name
+ * is opened as a regular device.
+ */
+#define TRANSPORT_PTY_PREFIX	"pty:"
+
+int transport_loopback(const char *kind);
+
+int transport_loopback_enabled(void);
+
+/* Same contract as open(2): a new fd, or -1 with errno set */
+int transport_open(const char *path, int flags);
+
+/*
+ * Sets RTS on a real port. On a loopback end there are no modem lines,
+ * deasserting RTS suspends the output of the other end instead.
+ */
+int transport_set_rts(int fd, int level);
+
+#endif /* TRANSPORT_H */
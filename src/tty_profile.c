@@ -0,0 +1,250 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <asm/termbits.h>
+
+#include "port.h"
+#include "serial.h"
+#include "tty_profile.h"
+
+struct tty_profile tty_profile = {
+	.enabled = 1,
+	.raw = 1,
+	.csize = 0,
+	.parity = 'N',
+	.stopbits = 1,
+	.vmin = 1,
+	.vtime = 0,
+	.flow = TTY_FLOW_KEEP,
+	.low_latency = -1,
+};
+
+static int parse_cc(const char *value, int *cc)
+{
+	char *end;
+	long n;
+
+	n = strtol(value, &end, 10);
+	if (end == value || *end || n < 0 || n > 255)
+		return -EINVAL;
+
+	*cc = n;
+	return 0;
+}
+
+static int parse_token(struct tty_profile *profile, const char *token)
+{
+	if (strcmp(token, "none") == 0) {
+		profile->enabled = 0;
+		return 0;
+	}
+
+	profile->enabled = 1;
+
+	if (strcmp(token, "raw") == 0) {
+		profile->raw = 1;
+	} else if (strcmp(token, "cooked") == 0) {
+		profile->raw = 0;
+	} else if (strncmp(token, "vmin=", 5) == 0) {
+		return parse_cc(token + 5, &profile->vmin);
+	} else if (strncmp(token, "vtime=", 6) == 0) {
+		return parse_cc(token + 6, &profile->vtime);
+	} else if (strcmp(token, "flow=none") == 0) {
+		profile->flow = TTY_FLOW_NONE;
+	} else if (strcmp(token, "flow=rtscts") == 0) {
+		profile->flow = TTY_FLOW_RTSCTS;
+	} else if (strcmp(token, "flow=xonxoff") == 0) {
+		profile->flow = TTY_FLOW_XONXOFF;
+	} else if (strcmp(token, "low_latency=on") == 0) {
+		profile->low_latency = 1;
+	} else if (strcmp(token, "low_latency=off") == 0) {
+		profile->low_latency = 0;
+	} else if (strlen(token) == 3 && token[0] >= '5' && token[0] <= '8' &&
+			strchr("NEO", token[1]) &&
+			(token[2] == '1' || token[2] == '2')) {
+		profile->csize = token[0] - '0';
+		profile->parity = token[1];
+		profile->stopbits = token[2] - '0';
+	} else {
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int tty_profile_parse(struct tty_profile *profile, const char *spec)
+{
+	char *copy, *token, *saveptr = NULL;
+	int ret = 0;
+
+	copy = strdup(spec);
+	if (!copy)
+		return -ENOMEM;
+
+	for (token = strtok_r(copy, ",", &saveptr); token && !ret;
+			token = strtok_r(NULL, ",", &saveptr))
+		ret = parse_token(profile, token);
+
+	free(copy);
+	return ret;
+}
+
+/*
+ * Same as cfmakeraw(3), which only knows the glibc struct termios, except
+ * for the data format which is left to the profile.
+ */
+static void make_raw(struct termios2 *tio)
+{
+	tio->c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR |
+		ICRNL | IXON);
+	tio->c_oflag &= ~OPOST;
+	tio->c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+	tio->c_cc[VMIN] = 1;
+	tio->c_cc[VTIME] = 0;
+}
+
+int tty_profile_apply(struct port *port, const struct tty_profile *profile)
+{
+	static const tcflag_t csizes[] = { CS5, CS6, CS7, CS8 };
+	struct termios2 tio;
+	int ret;
+
+	if (!profile->enabled)
+		return 0;
+
+	ret = port_get_termios(port, &tio);
+	if (ret)
+		return ret;
+
+	if (profile->raw)
+		make_raw(&tio);
+
+	tio.c_cflag |= CREAD | CLOCAL;
+
+	/* The format and flow control are only changed when given */
+	if (profile->csize) {
+		tio.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB);
+		tio.c_cflag |= csizes[profile->csize - 5];
+		if (profile->parity != 'N')
+			tio.c_cflag |= PARENB;
+		if (profile->parity == 'O')
+			tio.c_cflag |= PARODD;
+		if (profile->stopbits == 2)
+			tio.c_cflag |= CSTOPB;
+	}
+
+	if (profile->flow != TTY_FLOW_KEEP) {
+		tio.c_cflag &= ~CRTSCTS;
+		tio.c_iflag &= ~(IXON | IXOFF | IXANY);
+		if (profile->flow == TTY_FLOW_RTSCTS)
+			tio.c_cflag |= CRTSCTS;
+		else if (profile->flow == TTY_FLOW_XONXOFF)
+			tio.c_iflag |= IXON | IXOFF;
+	}
+
+	/* VMIN and VTIME only apply to non-canonical reads */
+	if (!(tio.c_lflag & ICANON)) {
+		tio.c_cc[VMIN] = profile->vmin;
+		tio.c_cc[VTIME] = profile->vtime;
+	}
+
+	return port_set_termios(port, &tio);
+}
+
+int tty_profile_apply_flow(struct port *port, int flow)
+{
+	struct tty_profile profile = tty_profile;
+
+	profile.enabled = 1;
+	profile.raw = 1;
+	profile.flow = flow;
+
+	return tty_profile_apply(port, &profile);
+}
+
+void tty_state_init(struct tty_state *state)
+{
+	state->port = NULL;
+	state->saved = NULL;
+	state->low_latency = -1;
+}
+
+int tty_state_attach(struct tty_state *state, struct port *port,
+		const struct tty_profile *profile)
+{
+	struct termios2 *saved;
+	int ret;
+
+	if (!profile->enabled)
+		return 0;
+
+	saved = (struct termios2 *)malloc(sizeof(*saved));
+	if (!saved)
+		return -ENOMEM;
+
+	ret = port_get_termios(port, saved);
+	if (ret)
+		goto e_free;
+
+	ret = tty_profile_apply(port, profile);
+	if (ret)
+		goto e_free;
+
+	state->port = port;
+	state->saved = saved;
+
+	if (profile->low_latency < 0)
+		return 0;
+
+	ret = serial_get_low_latency(port->fd);
+	if (ret < 0)
+		return ret;
+
+	state->low_latency = ret;
+	ret = serial_set_low_latency(port->fd, profile->low_latency);
+	if (ret)
+		state->low_latency = -1;
+
+	return ret;
+
+e_free:
+	free(saved);
+	return ret;
+}
+
+void tty_state_restore(struct tty_state *state)
+{
+	if (!state->port)
+		return;
+
+	if (state->low_latency >= 0)
+		serial_set_low_latency(state->port->fd, state->low_latency);
+
+	port_set_termios(state->port, (struct termios2 *)state->saved);
+	free(state->saved);
+	tty_state_init(state);
+}
@@ -0,0 +1,82 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TTY_PROFILE_H
+#define TTY_PROFILE_H
+
+struct port;
+
+enum {
+	TTY_FLOW_KEEP = -1,
+	TTY_FLOW_NONE,
+	TTY_FLOW_RTSCTS,
+	TTY_FLOW_XONXOFF,
+};
+
+/* Line settings applied to every port a command opens */
+struct tty_profile {
+	int enabled;	/* 0 leaves the port as it was */
+	int raw;	/* cfmakeraw, otherwise the line discipline is kept */
+	int csize;	/* data bits, 5 to 8, 0 keeps the port's format */
+	char parity;	/* 'N', 'E' or 'O' */
+	int stopbits;
+	int vmin;
+	int vtime;	/* deciseconds */
+	int flow;	/* TTY_FLOW_KEEP leaves the flow control alone */
+	int low_latency;	/* ASYNC_LOW_LATENCY, -1 keeps the driver's */
+};
+
+/* Settings saved when a profile is applied, restored afterwards */
+struct tty_state {
+	struct port *port;	/* NULL if unused */
+	void *saved;		/* struct termios2 */
+	int low_latency;	/* flag to restore, -1 if untouched */
+};
+
+extern struct tty_profile tty_profile;
+
+/*
+ * Comma separated list of "none", "raw", "cooked", a data format such as
+ * 8N1 or 7E2, "vmin=<n>", "vtime=<n>", "flow=none|rtscts|xonxoff" and
+ * "low_latency=on|off".
+ */
+int tty_profile_parse(struct tty_profile *profile, const char *spec);
+
+int tty_profile_apply(struct port *port, const struct tty_profile *profile);
+
+/* Applies the global profile in raw mode with the given flow control */
+int tty_profile_apply_flow(struct port *port, int flow);
+
+void tty_state_init(struct tty_state *state);
+
+/*
+ * Saves the current settings of the port, then applies the profile. The
+ * low latency flag is only changed here, not by tty_profile_apply. The
+ * port must stay open until tty_state_restore.
+ */
+int tty_state_attach(struct tty_state *state, struct port *port,
+		const struct tty_profile *profile);
+
+void tty_state_restore(struct tty_state *state);
+
+#endif /* TTY_PROFILE_H */
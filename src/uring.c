@@ -0,0 +1,233 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "timeutil.h"
+#include "uring.h"
+
+static int sys_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_uring_enter(int fd, unsigned int to_submit,
+		unsigned int min_complete, unsigned int flags, void *arg,
+		size_t size)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		flags, arg, size);
+}
+
+int uring_init(struct uring *ring, unsigned int entries)
+{
+	struct io_uring_params p;
+	int ret;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&p, 0, sizeof(p));
+
+	ring->fd = sys_uring_setup(entries, &p);
+	if (ring->fd < 0)
+		return -errno;
+
+	/* Timeouts are passed through IORING_ENTER_EXT_ARG */
+	if (!(p.features & IORING_FEAT_EXT_ARG)) {
+		ret = -EOPNOTSUPP;
+		goto e_close;
+	}
+
+	ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_size = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_size > ring->sq_size)
+			ring->sq_size = ring->cq_size;
+		ring->cq_size = ring->sq_size;
+	}
+
+	ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED) {
+		ret = -errno;
+		goto e_close;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else {
+		ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd,
+			IORING_OFF_CQ_RING);
+		if (ring->cq_ptr == MAP_FAILED) {
+			ret = -errno;
+			goto e_unmap_sq;
+		}
+	}
+
+	ring->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+		IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ret = -errno;
+		goto e_unmap_cq;
+	}
+
+	ring->sq_entries = p.sq_entries;
+	ring->sq_head = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.head);
+	ring->sq_tail = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.tail);
+	ring->sq_mask = (unsigned int *)((char *)ring->sq_ptr +
+		p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)((char *)ring->sq_ptr +
+		p.sq_off.array);
+	ring->sqe_tail = *ring->sq_tail;
+
+	ring->cq_head = (unsigned int *)((char *)ring->cq_ptr + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)((char *)ring->cq_ptr + p.cq_off.tail);
+	ring->cq_mask = (unsigned int *)((char *)ring->cq_ptr +
+		p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr +
+		p.cq_off.cqes);
+
+	return 0;
+
+e_unmap_cq:
+	if (ring->cq_ptr != ring->sq_ptr)
+		munmap(ring->cq_ptr, ring->cq_size);
+e_unmap_sq:
+	munmap(ring->sq_ptr, ring->sq_size);
+e_close:
+	close(ring->fd);
+	return ret;
+}
+
+void uring_destroy(struct uring *ring)
+{
+	munmap(ring->sqes, ring->sq_entries * sizeof(struct io_uring_sqe));
+	if (ring->cq_ptr != ring->sq_ptr)
+		munmap(ring->cq_ptr, ring->cq_size);
+	munmap(ring->sq_ptr, ring->sq_size);
+	close(ring->fd);
+}
+
+int uring_register_buffers(struct uring *ring, const struct iovec *iov,
+		unsigned int nr)
+{
+	if (syscall(__NR_io_uring_register, ring->fd,
+			IORING_REGISTER_BUFFERS, iov, nr))
+		return -errno;
+
+	return 0;
+}
+
+struct io_uring_sqe *uring_get_sqe(struct uring *ring)
+{
+	unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	struct io_uring_sqe *sqe;
+
+	if (ring->sqe_tail - head >= ring->sq_entries)
+		return NULL;
+
+	sqe = &ring->sqes[ring->sqe_tail & *ring->sq_mask];
+	ring->sq_array[ring->sqe_tail & *ring->sq_mask] =
+		ring->sqe_tail & *ring->sq_mask;
+	ring->sqe_tail++;
+
+	memset(sqe, 0, sizeof(*sqe));
+
+	return sqe;
+}
+
+void uring_prep_rw(struct io_uring_sqe *sqe, int op, int fd, void *buf,
+		unsigned int len, int buf_index, uint64_t user_data)
+{
+	sqe->opcode = op;
+	sqe->fd = fd;
+	/* Not seekable, the file position is used */
+	sqe->off = (uint64_t)-1;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = len;
+	sqe->buf_index = buf_index;
+	sqe->user_data = user_data;
+}
+
+void uring_prep_cancel_all(struct io_uring_sqe *sqe, uint64_t user_data)
+{
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+	sqe->user_data = user_data;
+}
+
+int uring_submit(struct uring *ring, unsigned int wait_nr, int timeout_ms)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned int to_submit, flags = 0;
+	int ret;
+
+	to_submit = ring->sqe_tail - *ring->sq_tail;
+	__atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+	if (wait_nr)
+		flags |= IORING_ENTER_GETEVENTS;
+
+	memset(&arg, 0, sizeof(arg));
+	if (timeout_ms >= 0) {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * NSEC_PER_MSEC;
+		arg.ts = (uintptr_t)&ts;
+	}
+
+	do {
+		ring->enters++;
+		ret = sys_uring_enter(ring->fd, to_submit, wait_nr,
+			flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	} while (ret < 0 && errno == EINTR);
+
+	/* Nothing was submitted and the wait timed out */
+	if (ret < 0 && errno == ETIME)
+		return 0;
+
+	return ret < 0 ? -errno : ret;
+}
+
+struct io_uring_cqe *uring_peek_cqe(struct uring *ring)
+{
+	unsigned int head = *ring->cq_head;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	return &ring->cqes[head & *ring->cq_mask];
+}
+
+void uring_cqe_seen(struct uring *ring)
+{
+	__atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,82 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <linux/io_uring.h>
+
+/* Minimal io_uring on top of the raw system calls */
+struct uring {
+	int fd;
+	unsigned int sq_entries;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned int sqe_tail;	/* prepared, not yet published */
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr;
+	void *cq_ptr;
+	size_t sq_size;
+	size_t cq_size;
+	uint64_t enters;	/* io_uring_enter calls */
+};
+
+int uring_init(struct uring *ring, unsigned int entries);
+
+void uring_destroy(struct uring *ring);
+
+int uring_register_buffers(struct uring *ring, const struct iovec *iov,
+		unsigned int nr);
+
+/* NULL once the submission queue is full */
+struct io_uring_sqe *uring_get_sqe(struct uring *ring);
+
+void uring_prep_rw(struct io_uring_sqe *sqe, int op, int fd, void *buf,
+		unsigned int len, int buf_index, uint64_t user_data);
+
+/* Cancels every request in flight */
+void uring_prep_cancel_all(struct io_uring_sqe *sqe, uint64_t user_data);
+
+/*
+ * Submits the prepared entries and waits for wait_nr completions, at
+ * most timeout_ms milliseconds if not negative. Returns the number of
+ * entries submitted or a negative error; a timeout only shows as fewer
+ * completions than requested.
+ */
+int uring_submit(struct uring *ring, unsigned int wait_nr, int timeout_ms);
+
+/* Next completion or NULL, release it with uring_cqe_seen */
+struct io_uring_cqe *uring_peek_cqe(struct uring *ring);
+
+void uring_cqe_seen(struct uring *ring);
+
+#endif /* URING_H */
@@ -0,0 +1,444 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Petre Pircalabu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cmd.h"
+#include "histogram.h"
+#include "io.h"
+#include "timeutil.h"
+#include "tty_profile.h"
+
+#define VMIN_SWEEP_COUNT		200
+#define VMIN_SWEEP_SIZE			16
+#define VMIN_SWEEP_MAX_SIZE		255
+#define VMIN_SWEEP_MAX_COUNT		0xffffff
+#define VMIN_SWEEP_TIMEOUT_MS		2000
+
+static const char vmin_sweep_help[] = "Usage:\n"
+	"\t uart_test vmin_sweep [options] <ttyDevice>\n"
+	"Echoes messages with the receiver reading under every VMIN/VTIME\n"
+	"combination, then reports read wakeups, CPU time and round trip\n"
+	"latency per message.\n"
+	"Options:\n"
+	"\t-r, --receiver\t\trun as receiver\n"
+	"\t-s, --sender\t\trun as sender (default)\n"
+	"\t-m, --vmin <list>\tVMIN values (default 0,1,4,16, sender only)\n"
+	"\t-t, --vtime <list>\tVTIME values in deciseconds (default 0,1,5,\n"
+	"\t\t\t\tsender only)\n"
+	"\t-n, --count <n>\t\tmessages per combination (default 200)\n"
+	"\t-k, --size <bytes>\tmessage size (default 16), combinations with\n"
+	"\t\t\t\ta larger VMIN are skipped\n";
+
+enum {
+	VMIN_SETUP = 1,
+	VMIN_STEP,
+	VMIN_READY,
+	VMIN_REPORT,
+	VMIN_DONE
+};
+
+struct vmin_sweep_data {
+	int receiver;
+	int fd;
+	struct port *port;
+	int count;
+	int size;
+	int vmin[256];
+	int nvmin;
+	int vtime[256];
+	int nvtime;
+};
+
+static int parse_cc_list(const char *list, int *values, int *count)
+{
+	char *copy, *token, *end, *saveptr = NULL;
+	long value;
+	int ret = 0;
+
+	copy = strdup(list);
+	if (!copy)
+		return -ENOMEM;
+
+	*count = 0;
+	for (token = strtok_r(copy, ",", &saveptr); token && *count < 256;
+			token = strtok_r(NULL, ",", &saveptr)) {
+		value = strtol(token, &end, 10);
+		if (end == token || *end || value < 0 || value > 255) {
+			ret = -EINVAL;
+			break;
+		}
+		values[(*count)++] = value;
+	}
+
+	if (!*count)
+		ret = -EINVAL;
+
+	free(copy);
+	return ret;
+}
+
+static int vmin_sweep_init(struct cmd *cmd, int argc, char *argv[])
+{
+	int ret, c;
+	const char *vmin_list = "0,1,4,16", *vtime_list = "0,1,5";
+	struct vmin_sweep_data *pdata;
+
+	pdata = (struct vmin_sweep_data *)calloc(1,
+		sizeof(struct vmin_sweep_data));
+	if (!pdata)
+		return -ENOMEM;
+
+	static struct option long_options[] = {
+		{"receiver", no_argument, 0, 'r'},
+		{"sender", no_argument, 0, 's'},
+		{"vmin", required_argument, 0, 'm'},
+		{"vtime", required_argument, 0, 't'},
+		{"count", required_argument, 0, 'n'},
+		{"size", required_argument, 0, 'k'},
+		{0, 0, 0, 0}
+	};
+
+	pdata->count = VMIN_SWEEP_COUNT;
+	pdata->size = VMIN_SWEEP_SIZE;
+
+	while (1) {
+		int option_index = 0;
+
+		c = getopt_long(argc, argv, "rsm:t:n:k:", long_options,
+			&option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'r':
+			pdata->receiver = 1;
+			break;
+		case 's':
+			pdata->receiver = 0;
+			break;
+		case 'm':
+			vmin_list = optarg;
+			break;
+		case 't':
+			vtime_list = optarg;
+			break;
+		case 'n':
+			pdata->count = atoi(optarg);
+			break;
+		case 'k':
+			pdata->size = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "vmin_sweep: Invalid option %s\n",
+				optarg);
+			ret = -EINVAL;
+			goto e_exit;
+		}
+	}
+
+	if (parse_cc_list(vmin_list, pdata->vmin, &pdata->nvmin) ||
+			parse_cc_list(vtime_list, pdata->vtime,
+			&pdata->nvtime) || pdata->count <= 0 ||
+			pdata->count > VMIN_SWEEP_MAX_COUNT ||
+			pdata->size < (int)sizeof(uint32_t) ||
+			pdata->size > VMIN_SWEEP_MAX_SIZE) {
+		fprintf(stderr, "vmin_sweep: Invalid parameters\n");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	if (optind != argc - 1) {
+		fprintf(stderr, "Please specify the tty device");
+		ret = -EINVAL;
+		goto e_exit;
+	}
+
+	pdata->fd = cmd_open_port(cmd, argv[optind], PORT_FLUSH, 0);
+	if (pdata->fd < 0) {
+		ret = pdata->fd;
+		goto e_exit;
+	}
+	pdata->port = &cmd->port;
+
+	cmd->priv = (void *) pdata;
+
+	return 0;
+
+e_exit:
+	free(pdata);
+	return ret;
+}
+
+/* Same settings as the profile, except for VMIN and VTIME */
+static int apply_cc(struct port *port, int vmin, int vtime)
+{
+	struct tty_profile profile = tty_profile;
+
+	profile.enabled = 1;
+	profile.raw = 1;
+	profile.vmin = vmin;
+	profile.vtime = vtime;
+
+	return tty_profile_apply(port, &profile);
+}
+
+/*
+ * Reads and echoes every message with the plain read(2) calls whose
+ * wakeups are being measured.
+ */
+static int echo_messages(struct vmin_sweep_data *pdata, uint32_t *reads,
+		uint64_t *cpu_ns)
+{
+	char buf[VMIN_SWEEP_MAX_SIZE];
+	uint64_t start = thread_cpu_ns();
+	ssize_t count;
+	int i, got, ret;
+
+	*reads = 0;
+
+	for (i = 0; i < pdata->count; i++) {
+		for (got = 0; got < pdata->size; got += count) {
+			count = read(pdata->fd, buf + got, pdata->size - got);
+			(*reads)++;
+			if (count < 0) {
+				if (errno == EINTR) {
+					count = 0;
+					continue;
+				}
+				return -errno;
+			}
+		}
+
+		ret = write_full(pdata->fd, buf, pdata->size);
+		if (ret)
+			return ret;
+	}
+
+	*cpu_ns = thread_cpu_ns() - start;
+
+	return 0;
+}
+
+static int vmin_sweep_receiver(struct vmin_sweep_data *pdata,
+		struct results *results)
+{
+	uint64_t cpu_ns = 0;
+	uint32_t reads;
+	int type, arg, ret;
+
+	while (1) {
+		ret = read_msg(pdata->fd, &type, &arg, -1);
+		if (ret)
+			return ret;
+
+		if (type == VMIN_DONE)
+			return 0;
+		if (type == VMIN_SETUP) {
+			pdata->count = (uint32_t)arg >> 8;
+			pdata->size = arg & 0xff;
+			continue;
+		}
+		if (type != VMIN_STEP || pdata->size < (int)sizeof(uint32_t))
+			return -EPROTO;
+
+		ret = apply_cc(pdata->port, (arg >> 8) & 0xff, arg & 0xff);
+		if (!ret)
+			ret = send_msg(pdata->fd, VMIN_READY, 0);
+		if (!ret)
+			ret = echo_messages(pdata, &reads, &cpu_ns);
+
+		/* Control messages are read with the default settings */
+		apply_cc(pdata->port, 1, 0);
+		if (ret)
+			return ret;
+
+		results_add_u64(results, "steps", 1);
+		results_add_u64(results, "rx_bytes",
+			(uint64_t)pdata->count * pdata->size);
+		results_add_u64(results, "tx_bytes",
+			(uint64_t)pdata->count * pdata->size);
+
+		ret = send_msg(pdata->fd, VMIN_REPORT, reads);
+		if (!ret)
+			ret = send_msg(pdata->fd, VMIN_REPORT,
+				cpu_ns / NSEC_PER_USEC);
+		if (ret)
+			return ret;
+	}
+}
+
+static int sweep_step(struct vmin_sweep_data *pdata, int vmin, int vtime,
+		struct histogram *rtt, uint64_t *errors)
+{
+	char msg[VMIN_SWEEP_MAX_SIZE], echo[VMIN_SWEEP_MAX_SIZE];
+	uint64_t start;
+	uint32_t seq;
+	int i, ret;
+
+	ret = send_msg(pdata->fd, VMIN_STEP, vmin << 8 | vtime);
+	if (!ret)
+		ret = expect_msg(pdata->fd, VMIN_READY, NULL,
+			VMIN_SWEEP_TIMEOUT_MS);
+	if (ret)
+		return ret;
+
+	memset(msg, 0x55, sizeof(msg));
+
+	for (i = 0; i < pdata->count; i++) {
+		seq = i;
+		memcpy(msg, &seq, sizeof(seq));
+
+		start = now_ns();
+		ret = write_full(pdata->fd, msg, pdata->size);
+		if (!ret)
+			ret = read_full(pdata->fd, echo, pdata->size,
+				VMIN_SWEEP_TIMEOUT_MS + vtime * 100);
+		if (ret)
+			return ret;
+
+		hist_record(rtt, now_ns() - start);
+		if (memcmp(msg, echo, pdata->size))
+			(*errors)++;
+	}
+
+	return 0;
+}
+
+static int vmin_sweep_sender(struct vmin_sweep_data *pdata,
+		struct results *results)
+{
+	struct histogram *rtt;
+	uint64_t errors;
+	int i, j, vmin, vtime, reads, cpu_us, ret;
+
+	rtt = (struct histogram *)malloc(sizeof(*rtt));
+	if (!rtt)
+		return -ENOMEM;
+
+	ret = send_msg(pdata->fd, VMIN_SETUP, (uint32_t)pdata->count << 8 |
+		pdata->size);
+	if (ret)
+		goto e_exit;
+
+	printf("%6s %6s %10s %12s %10s %10s %10s %8s\n", "VMIN", "VTIME",
+		"Reads/msg", "CPU(us)/msg", "p50(us)", "p99(us)", "max(us)",
+		"Errors");
+
+	for (i = 0; i < pdata->nvmin; i++) {
+		for (j = 0; j < pdata->nvtime; j++) {
+			vmin = pdata->vmin[i];
+			vtime = pdata->vtime[j];
+
+			/* The read would wait for the next message forever */
+			if (vmin > pdata->size) {
+				printf("%6d %6d %10s\n", vmin, vtime,
+					"skipped");
+				continue;
+			}
+
+			hist_init(rtt);
+			errors = 0;
+
+			ret = sweep_step(pdata, vmin, vtime, rtt, &errors);
+			if (!ret)
+				ret = expect_msg(pdata->fd, VMIN_REPORT,
+					&reads, VMIN_SWEEP_TIMEOUT_MS);
+			if (!ret)
+				ret = expect_msg(pdata->fd, VMIN_REPORT,
+					&cpu_us, VMIN_SWEEP_TIMEOUT_MS);
+			if (ret)
+				goto e_exit;
+
+			printf("%6d %6d %10.2f %12.2f %10.1f %10.1f %10.1f "
+				"%8" PRIu64 "\n", vmin, vtime,
+				(double)(uint32_t)reads / pdata->count,
+				(double)cpu_us / pdata->count,
+				(double)hist_percentile(rtt, 50.0) /
+				NSEC_PER_USEC,
+				(double)hist_percentile(rtt, 99.0) /
+				NSEC_PER_USEC,
+				(double)rtt->max / NSEC_PER_USEC, errors);
+
+			results_add_u64(results, "steps", 1);
+			results_add_u64(results, "tx_bytes",
+				(uint64_t)pdata->count * pdata->size);
+			results_add_u64(results, "rx_bytes",
+				(uint64_t)pdata->count * pdata->size);
+			results_add_u64(results, "errors", errors);
+		}
+	}
+
+	ret = send_msg(pdata->fd, VMIN_DONE, 0);
+
+e_exit:
+	free(rtt);
+	return ret;
+}
+
+static int vmin_sweep_exec(struct cmd *cmd)
+{
+	struct vmin_sweep_data *pdata = (struct vmin_sweep_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	if (pdata->receiver)
+		return vmin_sweep_receiver(pdata, &cmd->results);
+
+	return vmin_sweep_sender(pdata, &cmd->results);
+}
+
+static int vmin_sweep_cleanup(struct cmd *cmd)
+{
+	struct vmin_sweep_data *pdata = (struct vmin_sweep_data *)cmd->priv;
+
+	if (!pdata)
+		return -EINVAL;
+
+	free(pdata);
+	cmd->priv = NULL;
+
+	return 0;
+}
+
+REGISTER_CMD(
+	vmin_sweep,
+	"Read wakeups and latency over VMIN/VTIME combinations",
+	vmin_sweep_help,
+	vmin_sweep_init,
+	vmin_sweep_exec,
+	vmin_sweep_cleanup,
+	.flags = CMD_MULTIPORT,
+	.peer_opt = "-r"
+);
@@ -37,6 +37,7 @@
 #include <unistd.h>
 
 #include "cmd.h"
+#include "transport.h"
 
 const char waitbreak_help[] = "Usage:\n"
 	"\tuart_test waitbreak [options] <ttyDevice>\n";
@@ -58,7 +59,7 @@ static int waitbreak_func(struct waitbreak_data *pdata)
 		.tv_nsec = 0
 	};
 
-	fd = open(pdata->ttyname, O_RDWR);
+	fd = transport_open(pdata->ttyname, O_RDWR);
 	if (fd < 0) {
 		ret = -ENOENT;
 		goto e_exit;